@@ -0,0 +1,555 @@
+/*
+ * Covariant Script Regex Extension
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Copyright (C) 2017-2023 Michael Lee(李登淳)
+ *
+ * Email:   lee@covariant.cn, mikecovlee@163.com
+ * Github:  https://github.com/mikecovlee
+ * Website: http://covscript.org.cn
+ */
+// Native benchmarks for the regex and unicode extensions.
+// Usage: regex_benchmark [filter] [--min-time=seconds]
+// Only benchmarks whose name contains filter run. Each reports time per operation, throughput over the
+// subject bytes and heap allocations per operation, counted by the replaced global operator new.
+// Checks run first and end the run with a failure status when an operation allocates more than it may.
+#include "codecvt.hpp"
+#include "pcre2.hpp"
+#include "utf8_index.hpp"
+#include "unicode_class.hpp"
+
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <codecvt>
+#include <cstdio>
+#include <cstdlib>
+#include <cwctype>
+#include <new>
+#include <locale>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static std::atomic<size_t> allocation_count{0};
+static std::atomic<size_t> allocation_bytes{0};
+
+// GCC inlines these into standard allocators and then takes malloc and free for a mismatched pair
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void *operator new(size_t size)
+{
+	allocation_count.fetch_add(1, std::memory_order_relaxed);
+	allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+	if (void *p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+	allocation_count.fetch_add(1, std::memory_order_relaxed);
+	allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+	return std::malloc(size ? size : 1);
+}
+
+void operator delete(void *p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	std::free(p);
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &tag) noexcept
+{
+	return operator new(size, tag);
+}
+
+void operator delete[](void *p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+	std::free(p);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+namespace bench {
+	struct options {
+		std::string filter;
+		double min_time = 0.5;
+	};
+
+	options config;
+
+	// Keeps results alive so the optimizer cannot drop the work
+	template <typename T>
+	void keep(const T &value)
+	{
+#ifdef _MSC_VER
+		_ReadWriteBarrier();
+		static volatile const void *sink;
+		sink = &value;
+#else
+		asm volatile("" : : "r"(&value) : "memory");
+#endif
+	}
+
+	// Runs fn in batches, doubling the batch until one takes at least min_time seconds
+	template <typename F>
+	void run(const std::string &name, size_t bytes_per_op, F &&fn)
+	{
+		if (!config.filter.empty() && name.find(config.filter) == std::string::npos)
+			return;
+		fn();
+		using clock = std::chrono::steady_clock;
+		size_t iterations = 1;
+		double seconds = 0;
+		size_t allocations = 0;
+		for (;;) {
+			size_t before = allocation_count.load();
+			auto start = clock::now();
+			for (size_t i = 0; i < iterations; ++i)
+				fn();
+			seconds = std::chrono::duration<double>(clock::now() - start).count();
+			allocations = allocation_count.load() - before;
+			if (seconds >= config.min_time || iterations >= (size_t(1) << 30))
+				break;
+			iterations *= seconds > 0 ? std::min<size_t>(10, std::max<size_t>(2, size_t(config.min_time / seconds * 1.2))) : 10;
+		}
+		double ns = seconds * 1e9 / iterations;
+		std::printf("%-44s %12.0f ns %12zu", name.c_str(), ns, iterations);
+		if (bytes_per_op > 0)
+			std::printf(" %10.1f MB/s", bytes_per_op * iterations / seconds / 1e6);
+		else
+			std::printf(" %15s", "");
+		std::printf(" %10.2f allocs/op\n", double(allocations) / iterations);
+	}
+
+	// Exits with a failure status when one call of fn, after a warm-up call, allocates limit bytes or more
+	template <typename F>
+	void check_allocations(const std::string &name, size_t limit, F &&fn)
+	{
+		if (!config.filter.empty() && name.find(config.filter) == std::string::npos)
+			return;
+		fn();
+		size_t before = allocation_bytes.load();
+		fn();
+		size_t bytes = allocation_bytes.load() - before;
+		std::printf("%-44s %12zu bytes allocated, limit %zu\n", name.c_str(), bytes, limit);
+		if (bytes >= limit) {
+			std::fprintf(stderr, "%s allocated %zu bytes\n", name.c_str(), bytes);
+			std::exit(1);
+		}
+	}
+} // namespace bench
+
+namespace corpus {
+	// Deterministic so that runs can be compared
+	std::mt19937 &rng()
+	{
+		static std::mt19937 gen(20231016);
+		return gen;
+	}
+
+	std::string ascii_log(size_t lines)
+	{
+		static const char *levels[] = {"INFO", "WARN", "DEBUG", "ERROR"};
+		static const char *users[] = {"alice", "bob", "carol", "dave", "eve"};
+		static const char *paths[] = {"/api/v1/users", "/static/app.js", "/api/v1/orders/42", "/health", "/login"};
+		std::string out;
+		char line[256];
+		for (size_t i = 0; i < lines; ++i) {
+			unsigned r = rng()();
+			std::snprintf(line, sizeof(line), "2023-10-16 12:%02u:%02u.%03u %s [worker-%u] GET %s took %ums user=%s@example.com status=%u\n",
+			              r % 60, (r >> 6) % 60, (r >> 12) % 1000, levels[(r >> 4) % 4], (r >> 8) % 16, paths[(r >> 16) % 5],
+			              (r >> 20) % 900 + 1, users[(r >> 24) % 5], (r >> 27) % 2 ? 200 : 404);
+			out += line;
+		}
+		return out;
+	}
+
+	// Common Han characters with CJK punctuation and a little ASCII, as UTF-8
+	std::string cjk_utf8(size_t chars)
+	{
+		static const char32_t extra[] = {U'，', U'。', U'、', U'：', U' ', U'1', U'a'};
+		std::u32string wide;
+		for (size_t i = 0; i < chars; ++i) {
+			unsigned r = rng()();
+			if (r % 8 == 0)
+				wide.push_back(extra[(r >> 3) % 7]);
+			else
+				wide.push_back(0x4E00 + (r >> 3) % 0x51A5);
+		}
+		return std::wstring_convert<std::codecvt_utf8<char32_t>, char32_t>().to_bytes(wide);
+	}
+
+	// Double-byte GB2312 characters mixed with ASCII, as GBK bytes
+	std::string gbk(size_t chars)
+	{
+		std::string out;
+		for (size_t i = 0; i < chars; ++i) {
+			unsigned r = rng()();
+			if (r % 6 == 0)
+				out.push_back(static_cast<char>('a' + (r >> 3) % 26));
+			else {
+				out.push_back(static_cast<char>(0xB0 + (r >> 3) % 0x48));
+				out.push_back(static_cast<char>(0xA1 + (r >> 10) % 0x5E));
+			}
+		}
+		return out;
+	}
+} // namespace corpus
+
+// A search that finds nothing must not allocate in proportion to the subject, neither through the result nor
+// through the handle that results share
+static void allocation_checks()
+{
+	// Built without the corpus generator so that the benchmark corpora stay the same
+	std::string text;
+	for (int i = 0; i < 40000; ++i)
+		text += "2023-10-16 12:00:00.000 INFO [worker-1] GET /health took 12ms user=eve@example.com status=200\n";
+	const auto log = std::make_shared<const std::string>(std::move(text));
+	const pcre2_smatch::subject_t subject(log);
+	auto reg = std::make_shared<pcre2_regex>("took \\d{5}ms", true);
+	bench::check_allocations("check/failed_search/view", log->size(), [&] {
+		bench::keep(pcre2_regex_match(reg, *log, 0));
+	});
+	bench::check_allocations("check/failed_search/shared", log->size(), [&] {
+		bench::keep(pcre2_regex_match(reg, subject, 0));
+	});
+	bench::check_allocations("check/failed_find_all", log->size(), [&] {
+		bench::keep(pcre2_regex_find_all(*reg, *log));
+	});
+}
+
+static void regex_benchmarks()
+{
+	const std::string log = corpus::ascii_log(20000);
+	const std::string cjk = corpus::cjk_utf8(200000);
+	std::vector<std::string> lines;
+	for (size_t pos = 0, end; (end = log.find('\n', pos)) != std::string::npos; pos = end + 1)
+		lines.emplace_back(log, pos, end - pos);
+
+	const char *email = "[\\w.]+@[\\w]+\\.com";
+
+	bench::run("compile/simple", 0, [&] {
+		pcre2_regex reg(email, false);
+		bench::keep(reg);
+	});
+	bench::run("compile/jit", 0, [&] {
+		pcre2_regex reg(email, true);
+		bench::keep(reg);
+	});
+	bench::run("compile/cache_hit", 0, [&] {
+		bench::keep(pcre2_regex_cache::instance().get(email, true));
+	});
+
+	for (bool jit : {false, true}) {
+		std::string mode = jit ? "jit" : "interpreter";
+		auto reg = std::make_shared<pcre2_regex>("took (\\d+)ms user=(\\w+)", jit);
+		auto subject = std::make_shared<const std::string>(log);
+		bench::run("match/log_lines/" + mode, log.size(), [&] {
+			for (auto &line : lines)
+				bench::keep(pcre2_regex_match(reg, line, 0));
+		});
+		bench::run("test/log_lines/" + mode, log.size(), [&] {
+			size_t hits = 0;
+			for (auto &line : lines)
+				hits += pcre2_regex_find_pos(*reg, line).first != PCRE2_UNSET;
+			bench::keep(hits);
+		});
+		bench::run("count/log/" + mode, log.size(), [&] {
+			bench::keep(pcre2_regex_count(*reg, log));
+		});
+		bench::run("find_all/log/" + mode, log.size(), [&] {
+			size_t n = 0;
+			pcre2_regex_iterator it(reg, subject);
+			while (it.next())
+				++n;
+			bench::keep(n);
+		});
+		auto rare = std::make_shared<pcre2_regex>("ERROR\\b.*status=404", jit);
+		bench::run("search/log_rare_literal/" + mode, log.size(), [&] {
+			bench::keep(pcre2_regex_count(*rare, log));
+		});
+		auto han = std::make_shared<pcre2_regex>("\\p{Han}{4,}", jit);
+		bench::run("count/cjk_utf8/" + mode, cjk.size(), [&] {
+			bench::keep(pcre2_regex_count(*han, cjk));
+		});
+		bench::run("replace/log_digits/" + mode, log.size(), [&] {
+			bench::keep(pcre2_regex_replace(reg, log, "took #ms user=$2"));
+		});
+	}
+
+	// Same as test/log_lines/jit with per-regex statistics switched on, to keep their overhead visible
+	auto counted = std::make_shared<pcre2_regex>("took (\\d+)ms user=(\\w+)", true);
+	match_stats::enable(true);
+	bench::run("test/log_lines/jit_stats", log.size(), [&] {
+		size_t hits = 0;
+		for (auto &line : lines)
+			hits += pcre2_regex_find_pos(*counted, line).first != PCRE2_UNSET;
+		bench::keep(hits);
+	});
+	match_stats::enable(false);
+
+	auto digits = std::make_shared<pcre2_regex>("\\d+", true);
+	bench::run("replace_with/log_digits/jit", log.size(), [&] {
+		bench::keep(pcre2_regex_replace_with(digits, log, [&log] { return std::make_shared<const std::string>(log); }, [](const pcre2_smatch &, std::string &out) {
+			out.push_back('#');
+		}));
+	});
+
+	// Nested quantifiers against a subject that almost matches, which backtracks exponentially. The
+	// interpreter gives up at the match limit, so these time how quickly each mode fails or finishes.
+	std::string near_miss(22, 'a');
+	near_miss.push_back('b');
+	auto pathological = [&](const std::string &name, const pcre2_regex_config &config) {
+		auto reg = std::make_shared<pcre2_regex>("^(a+)+$", config);
+		bench::run("pathological/nested_quantifier/" + name, 0, [&] {
+			try {
+				bench::keep(pcre2_regex_find_pos(*reg, near_miss));
+			}
+			catch (const std::runtime_error &) {
+			}
+		});
+	};
+	pcre2_regex_config config;
+	pathological("interpreter", config);
+	config.match_limit = 10000;
+	pathological("match_limit", config);
+	config.match_limit = 0;
+	config.jit = true;
+	pathological("jit", config);
+	config.jit = false;
+	config.dfa = true;
+	pathological("dfa", config);
+}
+
+// One log line against sets of 10, 100 and 1000 route patterns, and against the same patterns one by one
+static void set_benchmarks()
+{
+	const std::string line = "2024-01-01 12:00:00 INFO [worker-3] GET /api/v1/users/42 completed in 12ms";
+	for (size_t n : {10, 100, 1000}) {
+		std::vector<pcre2_regex_t> regs;
+		for (size_t i = 0; i < n; ++i)
+			regs.push_back(std::make_shared<pcre2_regex>("GET /api/v" + std::to_string(i % 7) + "/route" + std::to_string(i) + "/(\\d+)", true));
+		const std::string count = std::to_string(n);
+		bench::run("set/build/" + count, 0, [&] {
+			pcre2_regex_set set;
+			for (auto &reg : regs)
+				set.add(reg);
+			set.prepare();
+			bench::keep(set.size());
+		});
+		pcre2_regex_set set;
+		for (auto &reg : regs)
+			set.add(reg);
+		set.prepare();
+		bench::run("set/matches/" + count, line.size(), [&] {
+			bench::keep(set.matches(line));
+		});
+		bench::run("set/sequential_search/" + count, line.size(), [&] {
+			size_t hits = 0;
+			for (auto &reg : regs)
+				hits += pcre2_regex_find_pos(*reg, line).first != PCRE2_UNSET;
+			bench::keep(hits);
+		});
+	}
+}
+
+static void codecvt_benchmarks()
+{
+	const std::string log = corpus::ascii_log(20000);
+	const std::string cjk = corpus::cjk_utf8(200000);
+	const std::string gbk = corpus::gbk(200000);
+
+	codecvt_impl::ascii ascii;
+	codecvt_impl::utf8 utf8;
+	codecvt_impl::gbk gbk_cvt;
+
+	const uwstring_t log_wide = ascii.local2wide(log);
+	const uwstring_t cjk_wide = utf8.local2wide(cjk);
+	const uwstring_t gbk_wide = gbk_cvt.local2wide(gbk);
+
+	bench::run("codecvt/ascii/local2wide", log.size(), [&] {
+		bench::keep(ascii.local2wide(log));
+	});
+	bench::run("codecvt/ascii/wide2local", log.size(), [&] {
+		bench::keep(ascii.wide2local(log_wide));
+	});
+	bench::run("codecvt/utf8/local2wide/ascii_log", log.size(), [&] {
+		bench::keep(utf8.local2wide(log));
+	});
+	bench::run("codecvt/utf8/local2wide/cjk", cjk.size(), [&] {
+		bench::keep(utf8.local2wide(cjk));
+	});
+	bench::run("codecvt/utf8/wide2local/cjk", cjk.size(), [&] {
+		bench::keep(utf8.wide2local(cjk_wide));
+	});
+	// Baseline for the UTF-8 transcoder, the standard library converter it replaced
+	std::wstring_convert<std::codecvt_utf8<char32_t>, char32_t> standard;
+	bench::run("codecvt/wstring_convert/local2wide/ascii_log", log.size(), [&] {
+		bench::keep(standard.from_bytes(log));
+	});
+	bench::run("codecvt/wstring_convert/local2wide/cjk", cjk.size(), [&] {
+		bench::keep(standard.from_bytes(cjk));
+	});
+	bench::run("codecvt/wstring_convert/wide2local/ascii_log", log.size(), [&] {
+		bench::keep(standard.to_bytes(log_wide));
+	});
+	bench::run("codecvt/wstring_convert/wide2local/cjk", cjk.size(), [&] {
+		bench::keep(standard.to_bytes(cjk_wide));
+	});
+	bench::run("codecvt/utf8/wide2local/ascii_log", log.size(), [&] {
+		bench::keep(utf8.wide2local(log_wide));
+	});
+	bench::run("codecvt/utf8/validate/cjk", cjk.size(), [&] {
+		bench::keep(utf8_transcode::validate(cjk));
+	});
+	bench::run("codecvt/utf8/decode_replace/cjk", cjk.size(), [&] {
+		bench::keep(utf8_transcode::decode(cjk, utf8_transcode::error_policy::replace));
+	});
+	bench::run("codecvt/gbk/local2wide", gbk.size(), [&] {
+		bench::keep(gbk_cvt.local2wide(gbk));
+	});
+	bench::run("codecvt/gbk/wide2local", gbk.size(), [&] {
+		bench::keep(gbk_cvt.wide2local(gbk_wide));
+	});
+#if COVSCRIPT_ABI_VERSION < 251108
+	// The packed legacy charset only exists with the codecvt classes of this extension
+	codecvt_impl::gbk_legacy gbk_legacy;
+	const uwstring_t gbk_packed = gbk_legacy.local2wide(gbk);
+	bench::run("codecvt/gbk_legacy/local2wide", gbk.size(), [&] {
+		bench::keep(gbk_legacy.local2wide(gbk));
+	});
+	bench::run("codecvt/gbk_legacy/wide2local", gbk.size(), [&] {
+		bench::keep(gbk_legacy.wide2local(gbk_packed));
+	});
+#endif
+	const size_t cjk_gb18030_size = gbk_codec::encode(cjk_wide, gbk_codec::variant::gb18030).size();
+	bench::run("codecvt/gb18030/wide2local/cjk", cjk_gb18030_size, [&] {
+		bench::keep(gbk_codec::encode(cjk_wide, gbk_codec::variant::gb18030));
+	});
+}
+
+static void index_benchmarks()
+{
+	const auto cjk = std::make_shared<const std::string>(corpus::cjk_utf8(200000));
+	const utf8_index index(cjk);
+	// Offsets spread over the whole string, queried in a scattered order
+	std::vector<size_t> bytes, chars;
+	std::mt19937 rng(7);
+	for (int i = 0; i < 1000; ++i) {
+		bytes.push_back(rng() % cjk->size());
+		chars.push_back(rng() % index.size());
+	}
+
+	bench::run("utf8_index/build/cjk", cjk->size(), [&] {
+		bench::keep(utf8_index(cjk).size());
+	});
+	bench::run("utf8_index/byte_to_char/1000", 0, [&] {
+		size_t sum = 0;
+		for (size_t b : bytes)
+			sum += index.byte_to_char(b);
+		bench::keep(sum);
+	});
+	bench::run("utf8_index/char_to_byte/1000", 0, [&] {
+		size_t sum = 0;
+		for (size_t c : chars)
+			sum += index.char_to_byte(c);
+		bench::keep(sum);
+	});
+	// What each lookup costs without the index
+	bench::run("utf8_index/linear_byte_to_char/1000", 0, [&] {
+		size_t sum = 0;
+		for (size_t b : bytes)
+			sum += std::count_if(cjk->begin(), cjk->begin() + b, [](char c) { return (c & 0xC0) != 0x80; });
+		bench::keep(sum);
+	});
+}
+
+static void class_benchmarks()
+{
+	const uwstring_t cjk = utf8_transcode::decode(corpus::cjk_utf8(200000));
+	const uwstring_t log = utf8_transcode::decode(corpus::ascii_log(20000));
+	std::vector<uint16_t> flags(std::max(cjk.size(), log.size()));
+
+	bench::run("unicode_class/classify/cjk", cjk.size() * 4, [&] {
+		unicode_class::classify(cjk, flags.data());
+		bench::keep(flags[0]);
+	});
+	bench::run("unicode_class/is_alpha/ascii_log", log.size() * 4, [&] {
+		size_t n = 0;
+		for (auto ch : log)
+			n += unicode_class::is(ch, unicode_class::alpha);
+		bench::keep(n);
+	});
+	bench::run("unicode_class/to_lower/ascii_log", log.size() * 4, [&] {
+		bench::keep(unicode_class::to_lower(log));
+	});
+	// Baseline, the C library classification the tables replaced
+	bench::run("unicode_class/iswalpha/ascii_log", log.size() * 4, [&] {
+		size_t n = 0;
+		for (auto ch : log)
+			n += std::iswalpha(ch) != 0;
+		bench::keep(n);
+	});
+	bench::run("unicode_class/towlower/ascii_log", log.size() * 4, [&] {
+		uwstring_t out;
+		out.reserve(log.size());
+		for (auto ch : log)
+			out.push_back(std::towlower(ch));
+		bench::keep(out);
+	});
+}
+
+int main(int argc, char **argv)
+{
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg.compare(0, 11, "--min-time=") == 0)
+			bench::config.min_time = std::atof(arg.c_str() + 11);
+		else
+			bench::config.filter = arg;
+	}
+	std::printf("%-44s %15s %12s %15s %20s\n", "Benchmark", "Time", "Iterations", "Throughput", "Allocations");
+	allocation_checks();
+	regex_benchmarks();
+	set_benchmarks();
+	codecvt_benchmarks();
+	index_benchmarks();
+	class_benchmarks();
+	return 0;
+}
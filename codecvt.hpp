@@ -0,0 +1,154 @@
+#pragma once
+#include <covscript/cni.hpp>
+
+#include "utf8_transcode.hpp"
+#include "unicode_class.hpp"
+#include "gbk_codec.hpp"
+
+using uwchar_t = char32_t;
+using uwstring_t = std::u32string;
+
+namespace codecvt_impl {
+#if COVSCRIPT_ABI_VERSION < 251108
+	using namespace cs;
+
+	class charset {
+	public:
+		virtual ~charset() = default;
+
+		virtual uwstring_t local2wide(const std::string &) = 0;
+
+		virtual std::string wide2local(const uwstring_t &) = 0;
+
+		virtual bool is_identifier(uwchar_t) = 0;
+	};
+
+	class ascii final : public charset {
+	public:
+		uwstring_t local2wide(const std::string &local) override
+		{
+			return uwstring_t(local.begin(), local.end());
+		}
+
+		std::string wide2local(const uwstring_t &str) override
+		{
+			std::string local;
+			local.reserve(str.size());
+			for (auto ch : str) local.push_back(ch);
+			return std::move(local);
+		}
+
+		bool is_identifier(uwchar_t ch) override
+		{
+			return ch < 0x80 && unicode_class::is(ch, unicode_class::id_continue);
+		}
+	};
+
+	class utf8 final : public charset {
+	public:
+		// Malformed input throws utf8_transcode::transcode_error, a std::range_error like wstring_convert threw
+		uwstring_t local2wide(const std::string &str) override
+		{
+			return utf8_transcode::decode(str);
+		}
+
+		std::string wide2local(const uwstring_t &str) override
+		{
+			return utf8_transcode::encode(str);
+		}
+
+		// XID_Continue and the underscore, which covers the Chinese characters and ASCII alphanumerics
+		bool is_identifier(uwchar_t ch) override
+		{
+			return unicode_class::is(ch, unicode_class::id_continue);
+		}
+	};
+
+	// Two-byte codes packed into one value as-is rather than mapped to Unicode, as gbk did before it used tables
+	class gbk_legacy final : public charset {
+		static inline uwchar_t set_zero(uwchar_t ch)
+		{
+			return ch & 0x0000ffff;
+		}
+
+		static constexpr std::uint8_t u8_blck_begin = 0x80;
+		static constexpr std::uint32_t u32_blck_begin = 0x8000;
+
+	public:
+		uwstring_t local2wide(const std::string &local) override
+		{
+			uwstring_t wide;
+			uint32_t head = 0;
+			bool read_next = true;
+			for (auto it = local.begin(); it != local.end();) {
+				if (read_next) {
+					head = *(it++);
+					if (head & u8_blck_begin)
+						read_next = false;
+					else
+						wide.push_back(set_zero(head));
+				}
+				else {
+					std::uint8_t tail = *(it++);
+					wide.push_back(set_zero(head << 8 | tail));
+					read_next = true;
+				}
+			}
+			if (!read_next) throw compile_error("Codecvt: Bad encoding.");
+			return std::move(wide);
+		}
+
+		std::string wide2local(const uwstring_t &wide) override
+		{
+			std::string local;
+			for (auto &ch : wide) {
+				if (ch & u32_blck_begin) local.push_back(ch >> 8);
+				local.push_back(ch);
+			}
+			return std::move(local);
+		}
+
+		bool is_identifier(uwchar_t ch) override
+		{
+			/**
+			 * Chinese Character in GBK Charset
+			 * GBK/2: 0xB0A1 - 0xF7FE
+			 * GBK/3: 0x8140 - 0xA0FE
+			 * GBK/4: 0xAA40 - 0xFEA0
+			 * GBK/5: 0xA996
+			 */
+			if (ch & u32_blck_begin)
+				return (ch >= 0xB0A1 && ch <= 0xF7FE) || (ch >= 0x8140 && ch <= 0xA0FE) ||
+				       (ch >= 0xAA40 && ch <= 0xFEA0) || ch == 0xA996;
+			else
+				return ch < 0x80 && unicode_class::is(ch, unicode_class::id_continue);
+		}
+	};
+
+	// Maps to and from real code points, so Unicode classification and regex properties apply
+	template <gbk_codec::variant type>
+	class gb_charset final : public charset {
+	public:
+		uwstring_t local2wide(const std::string &local) override
+		{
+			return gbk_codec::decode(local, type);
+		}
+
+		std::string wide2local(const uwstring_t &wide) override
+		{
+			return gbk_codec::encode(wide, type);
+		}
+
+		// Same identifier characters as utf8
+		bool is_identifier(uwchar_t ch) override
+		{
+			return unicode_class::is(ch, unicode_class::id_continue);
+		}
+	};
+
+	using gbk = gb_charset<gbk_codec::variant::gbk>;
+	using gb18030 = gb_charset<gbk_codec::variant::gb18030>;
+#else
+	using namespace cs::codecvt;
+#endif
+} // namespace codecvt_impl
@@ -0,0 +1,218 @@
+#pragma once
+#include <string_view>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <memory>
+
+#include "utf8_transcode.hpp"
+#include "gbk_tables.hpp"
+
+// GBK and GB18030 <-> UTF-32 conversion producing real code points, driven by the generated tables in
+// gbk_tables.hpp. GBK is taken as the one- and two-byte part of GB18030, which maps the user-defined
+// areas to the Private Use Area as Windows code page 936 does.
+namespace gbk_codec {
+	using utf8_transcode::error_policy;
+	using utf8_transcode::transcode_error;
+
+	enum class variant {
+		gbk,
+		gb18030
+	};
+
+	// Linear index of the first four-byte code outside the BMP, 0x90308130 which is U+10000
+	constexpr uint32_t supplementary_linear = ((0x90 - 0x81) * 10 + (0x30 - 0x30)) * 1260 + (0x81 - 0x81) * 10 + (0x30 - 0x30);
+	constexpr uint32_t bmp_linear_count = 39420;
+	constexpr size_t range_count = sizeof(four_byte_ranges) / sizeof(four_byte_ranges[0]);
+
+	// Two-byte code of every BMP code point, 0 where there is none. Built once by inverting the decode table.
+	inline const uint16_t *encode_table()
+	{
+		static const std::unique_ptr<uint16_t[]> table = [] {
+			std::unique_ptr<uint16_t[]> t(new uint16_t[0x10000]());
+			for (uint32_t lead = 0; lead < 126; ++lead) {
+				for (uint32_t trail = 0; trail < 191; ++trail) {
+					if (uint16_t cp = two_byte_table[lead * 191 + trail])
+						t[cp] = (0x81 + lead) << 8 | (0x40 + trail);
+				}
+			}
+			return t;
+		}();
+		return table.get();
+	}
+
+	inline char32_t bmp_from_linear(uint32_t linear)
+	{
+		size_t lo = 0, hi = range_count;
+		// Last run starting at or before linear
+		while (hi - lo > 1) {
+			size_t mid = (lo + hi) / 2;
+			if (four_byte_ranges[mid][0] <= linear)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		return four_byte_ranges[lo][1] + (linear - four_byte_ranges[lo][0]);
+	}
+
+	// Linear index of a BMP code point without a one- or two-byte code, or -1 for surrogates
+	inline int32_t linear_from_bmp(char32_t cp)
+	{
+		size_t lo = 0, hi = range_count;
+		while (hi - lo > 1) {
+			size_t mid = (lo + hi) / 2;
+			if (four_byte_ranges[mid][1] <= cp)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		uint32_t end = lo + 1 < range_count ? four_byte_ranges[lo + 1][0] : bmp_linear_count;
+		uint32_t linear = four_byte_ranges[lo][0] + (cp - four_byte_ranges[lo][1]);
+		return cp >= four_byte_ranges[lo][1] && linear < end ? int32_t(linear) : -1;
+	}
+
+	// Code point of the sequence at s, stored in cp; returns its length, or minus the number of bytes to skip
+	inline int sequence(const unsigned char *s, size_t remaining, variant type, char32_t &cp)
+	{
+		const unsigned char lead = s[0];
+		if (lead == 0x80 || lead == 0xFF || remaining < 2)
+			return -1;
+		const unsigned char b1 = s[1];
+		if (b1 >= 0x40 && b1 != 0x7F && b1 != 0xFF) {
+			cp = two_byte_table[(lead - 0x81) * 191 + (b1 - 0x40)];
+			return 2;
+		}
+		if (type != variant::gb18030 || b1 < 0x30 || b1 > 0x39 || remaining < 4 ||
+		        s[2] < 0x81 || s[2] > 0xFE || s[3] < 0x30 || s[3] > 0x39)
+			return -1;
+		// Well-formed four-byte code; without a mapping all four bytes are skipped
+		uint32_t linear = ((lead - 0x81) * 10 + (b1 - 0x30)) * 1260 + (s[2] - 0x81) * 10 + (s[3] - 0x30);
+		if (linear < bmp_linear_count)
+			cp = bmp_from_linear(linear);
+		else if (linear >= supplementary_linear && linear - supplementary_linear <= 0xFFFFF)
+			cp = 0x10000 + (linear - supplementary_linear);
+		else
+			return -4;
+		return 4;
+	}
+
+	// Appends the code points of in to out. On a strict failure out is left as it was.
+	inline void decode(std::string_view in, std::u32string &out, variant type, error_policy policy = error_policy::strict,
+	                   char32_t replacement = utf8_transcode::replacement_character)
+	{
+		const unsigned char *s = reinterpret_cast<const unsigned char *>(in.data());
+		const size_t n = in.size(), base = out.size();
+		// Never more code points than bytes
+		out.resize(base + n);
+		char32_t *dst = &out[0] + base;
+		size_t i = 0;
+		while (i < n) {
+			if (s[i] < 0x80) {
+				size_t run = utf8_transcode::widen_ascii(s + i, n - i, dst);
+				i += run;
+				dst += run;
+				while (i < n && s[i] < 0x80)
+					*dst++ = s[i++];
+				continue;
+			}
+			char32_t cp;
+			int len = sequence(s + i, n - i, type, cp);
+			if (len > 0) {
+				*dst++ = cp;
+				i += len;
+				continue;
+			}
+			if (policy == error_policy::strict) {
+				out.resize(base);
+				throw transcode_error("Codecvt: Bad " + std::string(type == variant::gbk ? "GBK" : "GB18030") +
+				                      " encoding at offset " + std::to_string(i) + ".", i);
+			}
+			if (policy == error_policy::replace)
+				*dst++ = replacement;
+			i += -len;
+		}
+		out.resize(dst - out.data());
+	}
+
+	inline std::u32string decode(std::string_view in, variant type, error_policy policy = error_policy::strict,
+	                             char32_t replacement = utf8_transcode::replacement_character)
+	{
+		std::u32string out;
+		decode(in, out, type, policy, replacement);
+		return out;
+	}
+
+	// Writes the code of cp at dst and returns its length, 0 when cp has none in this variant
+	inline size_t put(char32_t cp, variant type, unsigned char *dst)
+	{
+		if (cp < 0x80) {
+			dst[0] = cp;
+			return 1;
+		}
+		uint32_t linear;
+		if (cp < 0x10000) {
+			if (uint16_t code = encode_table()[cp]) {
+				dst[0] = code >> 8;
+				dst[1] = code & 0xFF;
+				return 2;
+			}
+			int32_t bmp = type == variant::gb18030 ? linear_from_bmp(cp) : -1;
+			if (bmp < 0)
+				return 0;
+			linear = bmp;
+		}
+		else if (type == variant::gb18030 && cp <= 0x10FFFF) {
+			linear = supplementary_linear + (cp - 0x10000);
+		}
+		else {
+			return 0;
+		}
+		dst[3] = 0x30 + linear % 10;
+		linear /= 10;
+		dst[2] = 0x81 + linear % 126;
+		linear /= 126;
+		dst[1] = 0x30 + linear % 10;
+		dst[0] = 0x81 + linear / 10;
+		return 4;
+	}
+
+	// Appends the encoded form of in to out. Code points without a code are invalid, as is a replacement
+	// that has none; on a strict failure out is left as it was.
+	inline void encode(std::u32string_view in, std::string &out, variant type, error_policy policy = error_policy::strict,
+	                   char32_t replacement = '?')
+	{
+		const size_t n = in.size(), base = out.size();
+		unsigned char replacement_code[4];
+		size_t replacement_size = put(replacement, type, replacement_code);
+		// Two bytes per code point covers everything but four-byte codes, which grow the output as they come
+		out.resize(base + 2 * n);
+		size_t pos = base;
+		for (size_t i = 0; i < n; ++i) {
+			if (out.size() - pos < 4)
+				out.resize(out.size() + 2 * (n - i) + 4);
+			unsigned char *dst = reinterpret_cast<unsigned char *>(&out[0]) + pos;
+			size_t len = put(in[i], type, dst);
+			if (len == 0) {
+				if (policy == error_policy::strict || (policy == error_policy::replace && replacement_size == 0)) {
+					out.resize(base);
+					throw transcode_error("Codecvt: Code point at index " + std::to_string(i) + " cannot be encoded in " +
+					                      (type == variant::gbk ? "GBK." : "GB18030."), i);
+				}
+				if (policy == error_policy::replace) {
+					std::copy(replacement_code, replacement_code + replacement_size, dst);
+					len = replacement_size;
+				}
+			}
+			pos += len;
+		}
+		out.resize(pos);
+	}
+
+	inline std::string encode(std::u32string_view in, variant type, error_policy policy = error_policy::strict,
+	                          char32_t replacement = '?')
+	{
+		std::string out;
+		encode(in, out, type, policy, replacement);
+		return out;
+	}
+} // namespace gbk_codec
@@ -0,0 +1,134 @@
+#pragma once
+#include <string_view>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define LITERAL_SEARCH_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LITERAL_SEARCH_SSE2
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace literal_search {
+	inline unsigned lowest_bit(uint32_t mask)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return index;
+#else
+		return __builtin_ctz(mask);
+#endif
+	}
+
+#if defined(LITERAL_SEARCH_AVX2)
+	using block_type = __m256i;
+
+	inline block_type load(const void *p)
+	{
+		return _mm256_loadu_si256(static_cast<const __m256i *>(p));
+	}
+
+	template <size_t unit>
+	block_type broadcast(uint32_t c)
+	{
+		if constexpr (unit == 1)
+			return _mm256_set1_epi8(static_cast<char>(c));
+		else if constexpr (unit == 2)
+			return _mm256_set1_epi16(static_cast<short>(c));
+		else
+			return _mm256_set1_epi32(static_cast<int>(c));
+	}
+
+	// One bit per byte of the block, set where both comparisons hold
+	template <size_t unit>
+	uint32_t match_mask(block_type a, block_type b, block_type x, block_type y)
+	{
+		if constexpr (unit == 1)
+			return _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, x), _mm256_cmpeq_epi8(b, y)));
+		else if constexpr (unit == 2)
+			return _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi16(a, x), _mm256_cmpeq_epi16(b, y)));
+		else
+			return _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi32(a, x), _mm256_cmpeq_epi32(b, y)));
+	}
+#elif defined(LITERAL_SEARCH_SSE2)
+	using block_type = __m128i;
+
+	inline block_type load(const void *p)
+	{
+		return _mm_loadu_si128(static_cast<const __m128i *>(p));
+	}
+
+	template <size_t unit>
+	block_type broadcast(uint32_t c)
+	{
+		if constexpr (unit == 1)
+			return _mm_set1_epi8(static_cast<char>(c));
+		else if constexpr (unit == 2)
+			return _mm_set1_epi16(static_cast<short>(c));
+		else
+			return _mm_set1_epi32(static_cast<int>(c));
+	}
+
+	template <size_t unit>
+	uint32_t match_mask(block_type a, block_type b, block_type x, block_type y)
+	{
+		if constexpr (unit == 1)
+			return _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, x), _mm_cmpeq_epi8(b, y)));
+		else if constexpr (unit == 2)
+			return _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi16(a, x), _mm_cmpeq_epi16(b, y)));
+		else
+			return _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi32(a, x), _mm_cmpeq_epi32(b, y)));
+	}
+#endif
+
+	// Position of the first occurrence of needle in haystack, or npos. Candidate positions are those where
+	// the first and last code units of the needle both line up; a whole block of them is tested at once and
+	// only candidates are compared in full.
+	template <typename CharT>
+	size_t find(std::basic_string_view<CharT> haystack, std::basic_string_view<CharT> needle)
+	{
+		const size_t n = haystack.size(), m = needle.size();
+		if (m == 0)
+			return 0;
+		if (m > n)
+			return std::basic_string_view<CharT>::npos;
+		const CharT *h = haystack.data();
+		size_t i = 0;
+#if defined(LITERAL_SEARCH_AVX2) || defined(LITERAL_SEARCH_SSE2)
+		constexpr size_t unit = sizeof(CharT);
+		constexpr size_t lanes = sizeof(block_type) / unit;
+		const block_type first = broadcast<unit>(static_cast<uint32_t>(needle[0]));
+		const block_type last = broadcast<unit>(static_cast<uint32_t>(needle[m - 1]));
+		while (i + m - 1 + lanes <= n) {
+			// Skip two blocks at a time while nothing lines up, the common case on long subjects
+			if (i + m - 1 + 2 * lanes <= n &&
+			        (match_mask<unit>(load(h + i), load(h + i + m - 1), first, last) |
+			         match_mask<unit>(load(h + i + lanes), load(h + i + lanes + m - 1), first, last)) == 0) {
+				i += 2 * lanes;
+				continue;
+			}
+			uint32_t mask = match_mask<unit>(load(h + i), load(h + i + m - 1), first, last);
+			while (mask != 0) {
+				size_t pos = i + lowest_bit(mask) / unit;
+				if (m <= 2 || std::memcmp(h + pos + 1, needle.data() + 1, (m - 2) * unit) == 0)
+					return pos;
+				// Every byte of the matching code unit has its bit set, clear them all
+				mask &= ~(((1u << unit) - 1) << (lowest_bit(mask)));
+			}
+			i += lanes;
+		}
+#endif
+		for (; i + m <= n; ++i) {
+			if (h[i] == needle[0] && h[i + m - 1] == needle[m - 1] && haystack.compare(i, m, needle) == 0)
+				return i;
+		}
+		return std::basic_string_view<CharT>::npos;
+	}
+} // namespace literal_search
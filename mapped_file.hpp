@@ -0,0 +1,104 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only mapping of a whole file, the contents are never copied
+class mapped_file {
+	const char *data = nullptr;
+	size_t length = 0;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#endif
+
+	void close()
+	{
+#ifdef _WIN32
+		if (data)
+			UnmapViewOfFile(data);
+		if (mapping)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+#else
+		if (data)
+			munmap(const_cast<char *>(data), length);
+#endif
+	}
+
+public:
+	explicit mapped_file(const std::string &path)
+	{
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			throw std::runtime_error("Failed to open file: " + path);
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size)) {
+			close();
+			throw std::runtime_error("Failed to stat file: " + path);
+		}
+		length = static_cast<size_t>(size.QuadPart);
+		if (length == 0)
+			return;
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping)
+			data = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		if (!data) {
+			close();
+			throw std::runtime_error("Failed to map file: " + path);
+		}
+#else
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			throw std::runtime_error("Failed to open file: " + path);
+		struct stat st;
+		if (fstat(fd, &st) != 0) {
+			::close(fd);
+			throw std::runtime_error("Failed to stat file: " + path);
+		}
+		length = static_cast<size_t>(st.st_size);
+		if (length > 0) {
+			void *addr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (addr == MAP_FAILED) {
+				::close(fd);
+				throw std::runtime_error("Failed to map file: " + path);
+			}
+			data = static_cast<const char *>(addr);
+			// Matching walks the mapping front to back
+			madvise(addr, length, MADV_SEQUENTIAL);
+		}
+		::close(fd);
+#endif
+	}
+
+	~mapped_file()
+	{
+		close();
+	}
+
+	mapped_file(const mapped_file &) = delete;
+	mapped_file &operator=(const mapped_file &) = delete;
+
+	// Never null, an empty file is not mapped and older PCRE2 releases reject a null subject even when empty
+	std::string_view view() const
+	{
+		return data ? std::string_view(data, length) : std::string_view("", 0);
+	}
+};
@@ -0,0 +1,97 @@
+#pragma once
+#include <chrono>
+#include <atomic>
+#include <cstdint>
+
+// Opt-in counters kept by every compiled regex. While stats are disabled the only cost per match is one
+// relaxed load of the global flag; while enabled each match adds a clock read and a few relaxed increments.
+struct match_stats {
+	using clock = std::chrono::steady_clock;
+
+	// Which engine handled a call; prefilter means the required literal was missing and PCRE2 never ran
+	enum engine_type {
+		prefilter,
+		interpreter,
+		jit,
+		dfa,
+		engine_count
+	};
+
+	struct snapshot {
+		uint64_t calls = 0;
+		uint64_t matches = 0;
+		// Subject bytes the calls covered, each from its start offset to the end of its match or of the subject,
+		// so that iterating over a subject counts it about once
+		uint64_t bytes = 0;
+		uint64_t nanoseconds = 0;
+		uint64_t engine_calls[engine_count] = {};
+		uint64_t limit_hits = 0;
+	};
+
+	std::atomic<uint64_t> calls{0};
+	std::atomic<uint64_t> matches{0};
+	std::atomic<uint64_t> bytes{0};
+	std::atomic<uint64_t> nanoseconds{0};
+	std::atomic<uint64_t> engine_calls[engine_count] = {};
+	std::atomic<uint64_t> limit_hits{0};
+
+	static std::atomic<bool> &flag()
+	{
+		static std::atomic<bool> value{false};
+		return value;
+	}
+
+	static bool enabled()
+	{
+		return flag().load(std::memory_order_relaxed);
+	}
+
+	static void enable(bool on)
+	{
+		flag().store(on, std::memory_order_relaxed);
+	}
+
+	// Start time for record(), left empty while stats are disabled
+	static clock::time_point start()
+	{
+		return enabled() ? clock::now() : clock::time_point();
+	}
+
+	void record(clock::time_point begin, uint64_t subject_bytes, bool matched, bool limit_hit, engine_type engine)
+	{
+		auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - begin).count();
+		calls.fetch_add(1, std::memory_order_relaxed);
+		if (matched)
+			matches.fetch_add(1, std::memory_order_relaxed);
+		if (subject_bytes)
+			bytes.fetch_add(subject_bytes, std::memory_order_relaxed);
+		nanoseconds.fetch_add(elapsed, std::memory_order_relaxed);
+		engine_calls[engine].fetch_add(1, std::memory_order_relaxed);
+		if (limit_hit)
+			limit_hits.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	snapshot read() const
+	{
+		snapshot s;
+		s.calls = calls.load(std::memory_order_relaxed);
+		s.matches = matches.load(std::memory_order_relaxed);
+		s.bytes = bytes.load(std::memory_order_relaxed);
+		s.nanoseconds = nanoseconds.load(std::memory_order_relaxed);
+		for (int i = 0; i < engine_count; ++i)
+			s.engine_calls[i] = engine_calls[i].load(std::memory_order_relaxed);
+		s.limit_hits = limit_hits.load(std::memory_order_relaxed);
+		return s;
+	}
+
+	void reset()
+	{
+		calls = 0;
+		matches = 0;
+		bytes = 0;
+		nanoseconds = 0;
+		for (auto &count : engine_calls)
+			count = 0;
+		limit_hits = 0;
+	}
+};
@@ -0,0 +1,127 @@
+#pragma once
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <mutex>
+
+// Persistent worker threads for data-parallel matching. Workers live as long as the module so
+// their thread-local pcre2_match_state (match data and JIT stack) stays warm between calls.
+class parallel_pool {
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable finished;
+	std::vector<std::thread> workers;
+	const std::function<void()> *task = nullptr;
+	size_t generation = 0;
+	// Workers still to pick up the current task / still running it
+	size_t wanted = 0;
+	size_t active = 0;
+	bool stopping = false;
+	// One parallel job at a time, concurrent callers queue here
+	std::mutex run_mutex;
+
+	void worker_main()
+	{
+		size_t seen = 0;
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;) {
+			wake.wait(lock, [&] {
+				return stopping || (generation != seen && wanted > 0);
+			});
+			if (stopping)
+				return;
+			seen = generation;
+			--wanted;
+			const std::function<void()> *job = task;
+			lock.unlock();
+			(*job)();
+			lock.lock();
+			if (--active == 0)
+				finished.notify_all();
+		}
+	}
+
+public:
+	static constexpr size_t max_threads = 256;
+
+	parallel_pool() = default;
+
+	~parallel_pool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (auto &worker : workers)
+			worker.join();
+	}
+
+	parallel_pool(const parallel_pool &) = delete;
+	parallel_pool &operator=(const parallel_pool &) = delete;
+
+	static parallel_pool &instance()
+	{
+		static parallel_pool pool;
+		return pool;
+	}
+
+	// 0 means one thread per hardware core
+	static size_t resolve_threads(size_t threads)
+	{
+		if (threads == 0)
+			threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+		return std::min(threads, max_threads);
+	}
+
+	// Calls fn(begin, end) over [0, count) in slices of grain items. Threads claim slices from a shared
+	// counter, so uneven inputs balance themselves. The caller works too; the first exception is rethrown.
+	template <typename F>
+	void for_each(size_t count, size_t threads, size_t grain, F &&fn)
+	{
+		grain = std::max<size_t>(grain, 1);
+		threads = std::min(resolve_threads(threads), (count + grain - 1) / grain);
+		std::atomic<size_t> next{0};
+		std::exception_ptr error;
+		std::mutex error_mutex;
+		std::function<void()> body = [&] {
+			try {
+				for (size_t begin = next.fetch_add(grain); begin < count; begin = next.fetch_add(grain))
+					fn(begin, std::min(begin + grain, count));
+			}
+			catch (...) {
+				std::lock_guard<std::mutex> lock(error_mutex);
+				if (!error)
+					error = std::current_exception();
+				next = count;
+			}
+		};
+		if (threads <= 1) {
+			body();
+		}
+		else {
+			std::lock_guard<std::mutex> run_lock(run_mutex);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				while (workers.size() < threads - 1)
+					workers.emplace_back(&parallel_pool::worker_main, this);
+				task = &body;
+				wanted = active = threads - 1;
+				++generation;
+			}
+			wake.notify_all();
+			body();
+			std::unique_lock<std::mutex> lock(mutex);
+			finished.wait(lock, [&] {
+				return active == 0;
+			});
+			task = nullptr;
+		}
+		if (error)
+			std::rethrow_exception(error);
+	}
+};
@@ -1,12 +1,34 @@
-#pragma once
-#include <string>
-#include <vector>
-#include <stdexcept>
-
+// Included once per code unit width: define PCRE2_CODE_UNIT_WIDTH, pcre2_stl_string and pcre2_stl_string_view
+// before each inclusion. pcre2.h declares every width and its generic names follow PCRE2_CODE_UNIT_WIDTH where
+// they are used, and every name below is width-suffixed, so one translation unit may hold several widths.
 #ifndef PCRE2_CODE_UNIT_WIDTH
 #define PCRE2_CODE_UNIT_WIDTH 8
 #endif
 
+#if PCRE2_CODE_UNIT_WIDTH == 8 && !defined(PCRE2_HPP_WIDTH_8)
+#define PCRE2_HPP_WIDTH_8
+#define PCRE2_HPP_BODY
+#elif PCRE2_CODE_UNIT_WIDTH == 16 && !defined(PCRE2_HPP_WIDTH_16)
+#define PCRE2_HPP_WIDTH_16
+#define PCRE2_HPP_BODY
+#elif PCRE2_CODE_UNIT_WIDTH == 32 && !defined(PCRE2_HPP_WIDTH_32)
+#define PCRE2_HPP_WIDTH_32
+#define PCRE2_HPP_BODY
+#endif
+
+#ifdef PCRE2_HPP_BODY
+#undef PCRE2_HPP_BODY
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include <list>
+#include <mutex>
+#include <memory>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+
 #define PCRE2_NAME_CONCAT_IMPL(a, b) a##_##b
 #define PCRE2_NAME_CONCAT(a, b) PCRE2_NAME_CONCAT_IMPL(a, b)
 #define PCRE2_RENAME(a) PCRE2_NAME_CONCAT(a, PCRE2_CODE_UNIT_WIDTH)
@@ -21,55 +43,378 @@
 
 #include <pcre2.h>
 
+#include "parallel.hpp"
+#include "literal_search.hpp"
+#include "match_stats.hpp"
+#include "shared_subject.hpp"
+
+#define pcre2_match_state PCRE2_RENAME(pcre2_match_state)
+
+// Mutable matching state, one per thread and shared by every regex matched on that thread.
+// Compiled regexes stay immutable, so one pcre2_regex can serve many threads without locking.
+struct pcre2_match_state {
+	pcre2_match_data *match_data = nullptr;
+	uint32_t ovector_size = 0;
+	pcre2_jit_stack *jit_stack = nullptr;
+	// Output scratch for pcre2_substitute
+	std::vector<PCRE2_UCHAR> buffer;
+	// Workspace for pcre2_dfa_match, doubled whenever a pattern runs out of it
+	std::vector<int> dfa_workspace;
+
+	static constexpr size_t buffer_keep_limit = 4 * 1024 * 1024;
+
+	pcre2_match_state() = default;
+
+	~pcre2_match_state()
+	{
+		if (jit_stack)
+			pcre2_jit_stack_free(jit_stack);
+		if (match_data)
+			pcre2_match_data_free(match_data);
+	}
+
+	pcre2_match_state(const pcre2_match_state &) = delete;
+	pcre2_match_state &operator=(const pcre2_match_state &) = delete;
+
+	static pcre2_match_state &local()
+	{
+		thread_local pcre2_match_state state;
+		return state;
+	}
+
+	pcre2_match_data *acquire(uint32_t pairs)
+	{
+		if (pairs > ovector_size) {
+			pcre2_match_data *data = pcre2_match_data_create(pairs, nullptr);
+			if (!data)
+				throw std::runtime_error("Failed to create match_data");
+			if (match_data)
+				pcre2_match_data_free(match_data);
+			match_data = data;
+			ovector_size = pairs;
+		}
+		return match_data;
+	}
+
+	// Hand very large scratch buffers back instead of pinning them to the thread
+	void trim_buffer()
+	{
+		if (buffer.size() > buffer_keep_limit)
+			std::vector<PCRE2_UCHAR>().swap(buffer);
+	}
+
+	// Installed on every JIT match context, hands out the calling thread's JIT stack
+	static pcre2_jit_stack *jit_stack_callback(void *)
+	{
+		pcre2_match_state &state = local();
+		if (!state.jit_stack)
+			state.jit_stack = pcre2_jit_stack_create(32 * 1024, 512 * 1024, nullptr);
+		return state.jit_stack;
+	}
+};
+
+#define pcre2_regex_config PCRE2_RENAME(pcre2_regex_config)
+
+// Everything a compiled regex depends on besides its pattern text
+struct pcre2_regex_config {
+	// pcre2_compile options
+	uint32_t options = PCRE2_UTF;
+	// One of PCRE2_NEWLINE_*, set through the compile context since it is not an option bit
+	uint32_t newline = PCRE2_NEWLINE_ANYCRLF;
+	bool jit = false;
+	// Match with pcre2_dfa_match: no backtracking and no captures, the longest leftmost match wins
+	bool dfa = false;
+	// Skip UTF validation of subjects on every match, only for input known to be valid
+	bool no_utf_check = false;
+	// Match context limits, 0 keeps the PCRE2 default
+	uint32_t match_limit = 0;
+	uint32_t depth_limit = 0;
+	uint32_t heap_limit = 0;
+
+	// Named boolean switches as used by build_ex, false if the name is unknown
+	bool set_flag(std::string_view name, bool on)
+	{
+		static const std::pair<std::string_view, uint32_t> compile_flags[] = {
+			{"caseless", PCRE2_CASELESS}, {"multiline", PCRE2_MULTILINE}, {"dotall", PCRE2_DOTALL},
+			{"extended", PCRE2_EXTENDED}, {"ungreedy", PCRE2_UNGREEDY}, {"literal", PCRE2_LITERAL},
+			{"no_auto_capture", PCRE2_NO_AUTO_CAPTURE}, {"anchored", PCRE2_ANCHORED}, {"dollar_endonly", PCRE2_DOLLAR_ENDONLY},
+			{"dupnames", PCRE2_DUPNAMES}, {"ucp", PCRE2_UCP}, {"utf", PCRE2_UTF}
+		};
+		for (auto &[flag_name, bit] : compile_flags) {
+			if (flag_name == name) {
+				options = on ? options | bit : options & ~bit;
+				return true;
+			}
+		}
+		if (name == "jit")
+			jit = on;
+		else if (name == "dfa")
+			dfa = on;
+		else if (name == "no_utf_check")
+			no_utf_check = on;
+		else
+			return false;
+		return true;
+	}
+
+	bool set_limit(std::string_view name, uint32_t value)
+	{
+		if (name == "match_limit")
+			match_limit = value;
+		else if (name == "depth_limit")
+			depth_limit = value;
+		else if (name == "heap_limit")
+			heap_limit = value;
+		else
+			return false;
+		return true;
+	}
+
+	bool set_newline(std::string_view name)
+	{
+		static const std::pair<std::string_view, uint32_t> conventions[] = {
+			{"cr", PCRE2_NEWLINE_CR}, {"lf", PCRE2_NEWLINE_LF}, {"crlf", PCRE2_NEWLINE_CRLF},
+			{"any", PCRE2_NEWLINE_ANY}, {"anycrlf", PCRE2_NEWLINE_ANYCRLF}, {"nul", PCRE2_NEWLINE_NUL}
+		};
+		for (auto &[convention, value] : conventions) {
+			if (convention == name) {
+				newline = value;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool operator==(const pcre2_regex_config &other) const
+	{
+		return options == other.options && newline == other.newline && jit == other.jit && dfa == other.dfa && no_utf_check == other.no_utf_check &&
+		       match_limit == other.match_limit && depth_limit == other.depth_limit && heap_limit == other.heap_limit;
+	}
+
+	size_t hash() const
+	{
+		size_t h = options;
+		for (size_t v : {size_t(newline), size_t(dfa << 2 | jit << 1 | no_utf_check), size_t(match_limit), size_t(depth_limit), size_t(heap_limit)})
+			h ^= v + 0x9e3779b9 + (h << 6) + (h >> 2);
+		return h;
+	}
+};
+
+#define pcre2_name_table PCRE2_RENAME(pcre2_name_table)
+
+// Group numbers by name, sorted by name. With PCRE2_DUPNAMES one name can stand for several groups.
+using pcre2_name_table = std::vector<std::pair<pcre2_stl_string, std::vector<uint32_t>>>;
+
 #define pcre2_regex PCRE2_RENAME(pcre2_regex)
+#define pcre2_required_literal PCRE2_RENAME(pcre2_required_literal)
+
+struct pcre2_regex;
+
+pcre2_stl_string pcre2_required_literal(const pcre2_regex &reg);
+
+#define pcre2_regex_registry PCRE2_RENAME(pcre2_regex_registry)
+
+// Every live pcre2_regex that has been called with stats enabled, so that match statistics can be listed
+// across all of them
+class pcre2_regex_registry {
+	std::mutex mutex;
+	std::list<const pcre2_regex *> regexes;
+
+public:
+	using handle_type = typename std::list<const pcre2_regex *>::iterator;
+
+	// Never destroyed: cached regexes are released during static destruction and still unregister
+	static pcre2_regex_registry &instance()
+	{
+		static pcre2_regex_registry *registry = new pcre2_regex_registry;
+		return *registry;
+	}
+
+	handle_type add(const pcre2_regex *reg)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return regexes.insert(regexes.end(), reg);
+	}
+
+	void remove(handle_type handle)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		regexes.erase(handle);
+	}
+
+	// Calls fn on each live regex; none can be destroyed meanwhile, so fn must not release regexes
+	template <typename F>
+	void for_each(F &&fn)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (const pcre2_regex *reg : regexes)
+			fn(*reg);
+	}
+};
 
 struct pcre2_regex {
 	pcre2_stl_string pattern;
-	pcre2_code *code;
-	pcre2_match_data *match_data;
-	// for JIT
+	pcre2_regex_config config;
+	pcre2_code *code = nullptr;
+	uint32_t capture_count = 0;
+	bool utf = false;
+	bool crlf_newline = false;
+	// Passed to every pcre2_match on top of the caller's options
+	uint32_t match_options = 0;
+	// Literal every match contains; subjects without it are turned away before reaching PCRE2
+	pcre2_stl_string prefilter;
+	// Read once from PCRE2_INFO_NAMETABLE and shared with every result, null without named groups
+	std::shared_ptr<const pcre2_name_table> names;
+	// for JIT and limits, read-only once constructed
 	pcre2_match_context *match_ctx = nullptr;
-	pcre2_jit_stack *jit_stack = nullptr;
+	// Deserialized patterns compile JIT code on their first match rather than at load time
+	bool jit_deferred = false;
+	static constexpr size_t dfa_workspace_limit = 1 << 20;
+	mutable std::once_flag jit_once;
+	// Filled in only while match_stats is enabled
+	mutable match_stats stats;
+	// A regex joins the registry on its first call with stats enabled, so that building and releasing
+	// regexes never takes the registry lock otherwise
+	mutable std::once_flag registry_once;
+	mutable bool registered = false;
+	mutable pcre2_regex_registry::handle_type registry_handle;
+
+	pcre2_regex(const pcre2_stl_string &pattern_v, bool try_jit = false) : pcre2_regex(pattern_v, make_config(try_jit)) {}
 
-	pcre2_regex(const pcre2_stl_string &pattern_v, bool try_jit = false) : pattern(pattern_v)
+	pcre2_regex(const pcre2_stl_string &pattern_v, const pcre2_regex_config &config_v) : pattern(pattern_v), config(config_v)
 	{
 		int errornumber;
 		PCRE2_SIZE erroroffset;
 
+		pcre2_compile_context *compile_ctx = pcre2_compile_context_create(nullptr);
+		if (!compile_ctx)
+			throw std::runtime_error("Failed to create compile context");
+		pcre2_set_newline(compile_ctx, config.newline);
+
 		code = pcre2_compile(
 		           reinterpret_cast<PCRE2_SPTR>(pattern.data()),
 		           pattern.size(),
-		           PCRE2_UTF | PCRE2_NEWLINE_ANYCRLF,
+		           config.options,
 		           &errornumber,
 		           &erroroffset,
-		           nullptr);
+		           compile_ctx);
+
+		pcre2_compile_context_free(compile_ctx);
 
 		if (!code)
-			throw std::runtime_error("PCRE2 compile failed");
+			throw std::runtime_error("PCRE2 compile failed at offset " + std::to_string(erroroffset) + ": " + error_message(errornumber));
 
-		match_data = pcre2_match_data_create_from_pattern(code, nullptr);
-		if (!match_data) {
+		try {
+			init();
+		}
+		catch (...) {
 			pcre2_code_free(code);
-			throw std::runtime_error("Failed to create match_data");
+			throw;
 		}
 
-		if (try_jit) {
-			match_ctx = pcre2_match_context_create(nullptr);
-			if (match_ctx != nullptr && pcre2_jit_compile(code, PCRE2_JIT_COMPLETE) == 0) {
-				jit_stack = pcre2_jit_stack_create(32 * 1024, 512 * 1024, nullptr);
-				pcre2_jit_stack_assign(match_ctx, nullptr, jit_stack);
+		if (config.jit && pcre2_jit_compile(code, PCRE2_JIT_COMPLETE) != 0)
+			config.jit = false;
+	}
+
+	// Takes ownership of an already compiled pattern, e.g. one decoded by pcre2_serialize_decode
+	pcre2_regex(const pcre2_stl_string &pattern_v, const pcre2_regex_config &config_v, pcre2_code *code_v) : pattern(pattern_v), config(config_v), code(code_v)
+	{
+		init();
+		jit_deferred = config.jit;
+	}
+
+	static pcre2_regex_config make_config(bool try_jit)
+	{
+		pcre2_regex_config config;
+		config.jit = try_jit;
+		return config;
+	}
+
+	static std::string error_message(int errornumber)
+	{
+		PCRE2_UCHAR buffer[256];
+		int len = pcre2_get_error_message(errornumber, buffer, sizeof(buffer) / sizeof(PCRE2_UCHAR));
+		// Messages are plain ASCII in every code unit width
+		return len < 0 ? "unknown error" : std::string(buffer, buffer + len);
+	}
+
+	void init()
+	{
+		// pcre2_dfa_match never runs JIT code
+		if (config.dfa)
+			config.jit = false;
+
+		pcre2_pattern_info(code, PCRE2_INFO_CAPTURECOUNT, &capture_count);
+
+		uint32_t info = 0;
+		pcre2_pattern_info(code, PCRE2_INFO_ALLOPTIONS, &info);
+		utf = (info & PCRE2_UTF) != 0;
+		pcre2_pattern_info(code, PCRE2_INFO_NEWLINE, &info);
+		crlf_newline = info == PCRE2_NEWLINE_ANY || info == PCRE2_NEWLINE_CRLF || info == PCRE2_NEWLINE_ANYCRLF;
+
+		if (config.no_utf_check && utf)
+			match_options |= PCRE2_NO_UTF_CHECK;
+
+		uint32_t name_count = 0, entry_size = 0;
+		PCRE2_SPTR table = nullptr;
+		pcre2_pattern_info(code, PCRE2_INFO_NAMECOUNT, &name_count);
+		if (name_count > 0) {
+			pcre2_pattern_info(code, PCRE2_INFO_NAMEENTRYSIZE, &entry_size);
+			pcre2_pattern_info(code, PCRE2_INFO_NAMETABLE, &table);
+			auto list = std::make_shared<pcre2_name_table>();
+			for (uint32_t i = 0; i < name_count; ++i, table += entry_size) {
+				// Entries are the group number (two big-endian bytes in 8-bit mode) followed by the name
+#if PCRE2_CODE_UNIT_WIDTH == 8
+				uint32_t number = table[0] << 8 | table[1];
+				PCRE2_SPTR name = table + 2;
+#else
+				uint32_t number = table[0];
+				PCRE2_SPTR name = table + 1;
+#endif
+				pcre2_stl_string name_str(reinterpret_cast<const typename pcre2_stl_string::value_type *>(name));
+				// The table is sorted by name, so duplicates are adjacent and in group order
+				if (list->empty() || list->back().first != name_str)
+					list->emplace_back(std::move(name_str), std::vector<uint32_t>());
+				list->back().second.push_back(number);
 			}
+			names = std::move(list);
+		}
+
+		// A single code unit is no better than the first/last code unit scan PCRE2 already does
+		prefilter = pcre2_required_literal(*this);
+		if (prefilter.size() < 2)
+			prefilter.clear();
+
+		if (config.jit || config.match_limit || config.depth_limit || config.heap_limit) {
+			match_ctx = pcre2_match_context_create(nullptr);
+			if (!match_ctx)
+				throw std::runtime_error("Failed to create match context");
+			if (config.jit)
+				pcre2_jit_stack_assign(match_ctx, pcre2_match_state::jit_stack_callback, nullptr);
+			if (config.match_limit)
+				pcre2_set_match_limit(match_ctx, config.match_limit);
+			if (config.depth_limit)
+				pcre2_set_depth_limit(match_ctx, config.depth_limit);
+			if (config.heap_limit)
+				pcre2_set_heap_limit(match_ctx, config.heap_limit);
 		}
 	}
 
+	// Must run before code is handed to anything that matches; JIT compiling is not safe while other threads match
+	void prepare() const
+	{
+		if (jit_deferred)
+			std::call_once(jit_once, [this] {
+				pcre2_jit_compile(code, PCRE2_JIT_COMPLETE);
+			});
+	}
+
 	~pcre2_regex()
 	{
-		if (jit_stack)
-			pcre2_jit_stack_free(jit_stack);
+		if (registered)
+			pcre2_regex_registry::instance().remove(registry_handle);
 		if (match_ctx)
 			pcre2_match_context_free(match_ctx);
-		if (match_data)
-			pcre2_match_data_free(match_data);
 		if (code)
 			pcre2_code_free(code);
 	}
@@ -77,37 +422,219 @@ struct pcre2_regex {
 	pcre2_regex(const pcre2_regex &) = delete;
 	pcre2_regex(pcre2_regex &&other) noexcept = delete;
 	pcre2_regex &operator=(const pcre2_regex &) = delete;
+
+	// Match data of the calling thread, large enough for every group of this pattern
+	pcre2_match_data *match_data() const
+	{
+		return pcre2_match_state::local().acquire(capture_count + 1);
+	}
+
+	// True when the subject from start lacks the literal every match contains, so no match can start there.
+	// A partial match can stop short of the literal
+	bool prefilter_rejects(pcre2_stl_string_view subject, PCRE2_SIZE start, uint32_t option) const
+	{
+		return !prefilter.empty() && !(option & (PCRE2_PARTIAL_HARD | PCRE2_PARTIAL_SOFT)) && start <= subject.size() &&
+		       literal_search::find(subject.substr(start), pcre2_stl_string_view(prefilter)) == pcre2_stl_string_view::npos;
+	}
+
+	int exec(PCRE2_SPTR subject, PCRE2_SIZE length, PCRE2_SIZE start, uint32_t option, pcre2_match_data *data) const
+	{
+		const match_stats::clock::time_point begin = match_stats::start();
+		int rc;
+		match_stats::engine_type used = engine(option);
+		if (prefilter_rejects(pcre2_stl_string_view(reinterpret_cast<const typename pcre2_stl_string::value_type *>(subject), length), start, option)) {
+			rc = PCRE2_ERROR_NOMATCH;
+			used = match_stats::prefilter;
+		}
+		else if (config.dfa) {
+			rc = dfa_exec(subject, length, start, (option | match_options) & ~PCRE2_NO_JIT, data);
+		}
+		else {
+			prepare();
+			rc = pcre2_match(code, subject, length, start, option | match_options, data, match_ctx);
+		}
+		if (begin != match_stats::clock::time_point()) {
+			const PCRE2_SIZE end = rc >= 0 ? pcre2_get_ovector_pointer(data)[1] : length;
+			record_stats(begin, end > start ? (end - start) * sizeof(PCRE2_UCHAR) : 0, rc >= 0, limit_error(rc), used);
+		}
+		// A pattern that blows its limits must not look like a plain miss
+		if (limit_error(rc))
+			throw std::runtime_error("PCRE2 match limit exceeded");
+		if (rc == PCRE2_ERROR_DFA_UITEM || rc == PCRE2_ERROR_DFA_UCOND || rc == PCRE2_ERROR_DFA_WSSIZE)
+			throw std::runtime_error("Pattern cannot be matched in DFA mode");
+		// \K in a lookaround can end a match before its start, which has no length and no place to resume from
+		if (rc >= 0) {
+			const PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(data);
+			if (ovector[1] < ovector[0])
+				throw std::runtime_error("Match ends before its start, \\K in a lookaround is not supported");
+		}
+		return rc;
+	}
+
+	// Only called while stats are enabled
+	void record_stats(match_stats::clock::time_point begin, uint64_t bytes, bool matched, bool limit_hit, match_stats::engine_type used) const
+	{
+		std::call_once(registry_once, [this] {
+			registry_handle = pcre2_regex_registry::instance().add(this);
+			registered = true;
+		});
+		stats.record(begin, bytes, matched, limit_hit, used);
+	}
+
+	static bool limit_error(int rc)
+	{
+		return rc == PCRE2_ERROR_MATCHLIMIT || rc == PCRE2_ERROR_DEPTHLIMIT || rc == PCRE2_ERROR_HEAPLIMIT || rc == PCRE2_ERROR_JIT_STACKLIMIT;
+	}
+
+	// Engine pcre2_match picks for these options, PCRE2_NO_JIT falls back to the interpreter
+	match_stats::engine_type engine(uint32_t option) const
+	{
+		if (config.dfa)
+			return match_stats::dfa;
+		return config.jit && !(option & PCRE2_NO_JIT) ? match_stats::jit : match_stats::interpreter;
+	}
+
+	// Only group 0 is reported, holding the longest of the matches that start at the leftmost position
+	int dfa_exec(PCRE2_SPTR subject, PCRE2_SIZE length, PCRE2_SIZE start, uint32_t option, pcre2_match_data *data) const
+	{
+		std::vector<int> &workspace = pcre2_match_state::local().dfa_workspace;
+		if (workspace.empty())
+			workspace.resize(1024);
+		for (;;) {
+			int rc = pcre2_dfa_match(code, subject, length, start, option, data, match_ctx, workspace.data(), workspace.size());
+			if (rc != PCRE2_ERROR_DFA_WSSIZE || workspace.size() >= dfa_workspace_limit)
+				return rc >= 0 ? 1 : rc;
+			workspace.resize(workspace.size() * 2);
+		}
+	}
+
+	// Matching engine in use, for comparing modes in benchmarks
+	const char *mode() const
+	{
+		return config.dfa ? "dfa" : config.jit ? "jit" : "interpreter";
+	}
+
+	// Offset of the character after the one at off, a CRLF pair counts as one when CRLF is a newline
+	size_t advance(PCRE2_SPTR subject, size_t length, size_t off) const
+	{
+		if (crlf_newline && off + 1 < length && subject[off] == '\r' && subject[off + 1] == '\n')
+			return off + 2;
+		++off;
+#if PCRE2_CODE_UNIT_WIDTH == 8
+		if (utf)
+			while (off < length && (subject[off] & 0xc0) == 0x80) ++off;
+#elif PCRE2_CODE_UNIT_WIDTH == 16
+		if (utf && off < length && (subject[off] & 0xfc00) == 0xdc00)
+			++off;
+#endif
+		return off;
+	}
+
+	// Offset of the character count characters before off
+	size_t retreat([[maybe_unused]] PCRE2_SPTR subject, size_t off, size_t count) const
+	{
+		for (; count > 0 && off > 0; --count) {
+			--off;
+#if PCRE2_CODE_UNIT_WIDTH == 8
+			if (utf)
+				while (off > 0 && (subject[off] & 0xc0) == 0x80) --off;
+#elif PCRE2_CODE_UNIT_WIDTH == 16
+			if (utf && off > 0 && (subject[off] & 0xfc00) == 0xdc00)
+				--off;
+#endif
+		}
+		return off;
+	}
 };
 
 #define pcre2_smatch PCRE2_RENAME(pcre2_smatch)
 
+// Match result holding offsets only. A result that matched shares the subject with the other results of
+// its call, and groups are sliced out of it on demand; one that did not holds no subject at all.
 struct pcre2_smatch {
+	using subject_t = shared_subject<pcre2_stl_string>;
+
 	bool ready = false;
-	pcre2_stl_string input;
-	std::vector<pcre2_stl_string_view> groups;
+	subject_t subject;
 	std::vector<std::pair<size_t, size_t>> offsets;
+	// Offset of the subject within the original input, non-zero for results cut out of a stream
+	size_t base = 0;
+	std::shared_ptr<const pcre2_name_table> names;
+
+	pcre2_smatch() = default;
+
+	explicit pcre2_smatch(subject_t subject_s) : subject(std::move(subject_s)) {}
+
+	// Takes the groups of a successful match of reg out of its ovector
+	void assign(const pcre2_regex &reg, const PCRE2_SIZE *ovector, int rc)
+	{
+		offsets.clear();
+		offsets.reserve(rc);
+		for (int i = 0; i < rc; ++i)
+			offsets.emplace_back(ovector[2 * i], ovector[2 * i + 1]);
+		names = reg.names;
+		ready = true;
+	}
+
+	// Group number for a name; of several groups sharing it the first that took part in the match wins
+	size_t group_index(pcre2_stl_string_view name) const
+	{
+		if (names) {
+			auto it = std::lower_bound(names->begin(), names->end(), name, [](const auto &entry, pcre2_stl_string_view key) {
+				return pcre2_stl_string_view(entry.first) < key;
+			});
+			if (it != names->end() && it->first == name) {
+				for (uint32_t number : it->second) {
+					if (number < offsets.size() && offsets[number].first != PCRE2_UNSET)
+						return number;
+				}
+				return it->second.front();
+			}
+		}
+		throw std::out_of_range("Invalid group name");
+	}
 
-	pcre2_smatch(pcre2_stl_string_view input_s) : input(input_s) {}
+	// An unset group, or one beyond the last that matched, reads as empty
+	pcre2_stl_string_view named(pcre2_stl_string_view name) const
+	{
+		size_t i = group_index(name);
+		return i < offsets.size() ? str(i) : pcre2_stl_string_view();
+	}
 
 	bool empty() const
 	{
-		return groups.empty();
+		return offsets.empty();
 	}
 
 	size_t size() const
 	{
-		return groups.size();
+		return offsets.size();
+	}
+
+	bool matched(size_t i) const
+	{
+		if (i >= offsets.size())
+			throw std::out_of_range("Invalid group index");
+		return offsets[i].first != PCRE2_UNSET;
+	}
+
+	pcre2_stl_string_view input() const
+	{
+		return subject.view();
 	}
 
 	pcre2_stl_string_view str(size_t i) const
 	{
-		return groups[i];
+		if (!matched(i))
+			return pcre2_stl_string_view();
+		auto [start, end] = offsets[i];
+		return input().substr(start, end - start);
 	}
 
 	size_t length(size_t i) const
 	{
-		if (i >= offsets.size())
-			throw std::out_of_range("Invalid group index");
+		if (!matched(i))
+			return 0;
 		auto [start, end] = offsets[i];
 		return end - start;
 	}
@@ -116,97 +643,1410 @@ struct pcre2_smatch {
 	{
 		if (i >= offsets.size())
 			throw std::out_of_range("Invalid group index");
-		return offsets[i].first;
+		return base + offsets[i].first;
 	}
 
-	pcre2_stl_string prefix() const
+	pcre2_stl_string_view prefix() const
 	{
+		pcre2_stl_string_view in = input();
 		if (offsets.empty())
-			return input;
+			return in;
 		else
-			return input.substr(0, offsets[0].first);
+			return in.substr(0, std::min(offsets[0].first, in.size()));
 	}
 
-	pcre2_stl_string suffix() const
+	pcre2_stl_string_view suffix() const
 	{
+		pcre2_stl_string_view in = input();
 		if (offsets.empty())
-			return input;
+			return in;
 		else
-			return input.substr(offsets.back().second);
+			return in.substr(std::min(offsets[0].second, in.size()));
 	}
 };
 
+#define pcre2_regex_t PCRE2_RENAME(pcre2_regex_t)
+
 using pcre2_regex_t = std::shared_ptr<pcre2_regex>;
 
+#define pcre2_regex_cache PCRE2_RENAME(pcre2_regex_cache)
+
+// LRU cache of compiled patterns, keyed on pattern text and configuration.
+// Each code unit width gets its own instance since the class name is width-suffixed.
+class pcre2_regex_cache {
+public:
+	struct stats_type {
+		size_t hits = 0;
+		size_t misses = 0;
+		size_t evictions = 0;
+		size_t size = 0;
+		size_t capacity = 0;
+	};
+
+private:
+	struct key_type {
+		pcre2_stl_string pattern;
+		pcre2_regex_config config;
+
+		bool operator==(const key_type &other) const
+		{
+			return config == other.config && pattern == other.pattern;
+		}
+	};
+
+	struct key_hash {
+		size_t operator()(const key_type &key) const
+		{
+			size_t h = std::hash<pcre2_stl_string>()(key.pattern);
+			return h ^ (key.config.hash() + 0x9e3779b9 + (h << 6) + (h >> 2));
+		}
+	};
+
+	using entry_type = std::pair<key_type, pcre2_regex_t>;
+
+	std::mutex mutex;
+	// Most recently used entries first
+	std::list<entry_type> entries;
+	std::unordered_map<key_type, typename std::list<entry_type>::iterator, key_hash> index;
+	stats_type counters;
+
+	void shrink_to(size_t n)
+	{
+		while (entries.size() > n) {
+			index.erase(entries.back().first);
+			entries.pop_back();
+			++counters.evictions;
+		}
+	}
+
+public:
+	static constexpr size_t default_capacity = 256;
+
+	pcre2_regex_cache()
+	{
+		counters.capacity = default_capacity;
+	}
+
+	static pcre2_regex_cache &instance()
+	{
+		static pcre2_regex_cache cache;
+		return cache;
+	}
+
+	pcre2_regex_t get(const pcre2_stl_string &pattern, bool try_jit)
+	{
+		return get(pattern, pcre2_regex::make_config(try_jit));
+	}
+
+	pcre2_regex_t get(const pcre2_stl_string &pattern, const pcre2_regex_config &config)
+	{
+		key_type key{pattern, config};
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto it = index.find(key);
+			if (it != index.end()) {
+				++counters.hits;
+				entries.splice(entries.begin(), entries, it->second);
+				return it->second->second;
+			}
+			++counters.misses;
+			if (counters.capacity == 0)
+				return std::make_shared<pcre2_regex>(pattern, config);
+		}
+		// Compile outside of the lock so that slow JIT compiles do not serialize other lookups
+		pcre2_regex_t reg = std::make_shared<pcre2_regex>(pattern, config);
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = index.find(key);
+		if (it != index.end()) {
+			entries.splice(entries.begin(), entries, it->second);
+			return it->second->second;
+		}
+		if (counters.capacity == 0)
+			return reg;
+		entries.emplace_front(std::move(key), reg);
+		index.emplace(entries.front().first, entries.begin());
+		shrink_to(counters.capacity);
+		return reg;
+	}
+
+	// Adds a regex compiled elsewhere so that later lookups of its pattern reuse it
+	void insert(const pcre2_regex_t &reg)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (counters.capacity == 0)
+			return;
+		key_type key{reg->pattern, reg->config};
+		auto it = index.find(key);
+		if (it != index.end()) {
+			entries.splice(entries.begin(), entries, it->second);
+			return;
+		}
+		entries.emplace_front(std::move(key), reg);
+		index.emplace(entries.front().first, entries.begin());
+		shrink_to(counters.capacity);
+	}
+
+	void set_capacity(size_t capacity)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		counters.capacity = capacity;
+		shrink_to(capacity);
+	}
+
+	void clear()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		index.clear();
+		entries.clear();
+	}
+
+	stats_type stats()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stats_type s = counters;
+		s.size = entries.size();
+		return s;
+	}
+};
+
+#define pcre2_regex_stats_entry PCRE2_RENAME(pcre2_regex_stats_entry)
+
+struct pcre2_regex_stats_entry {
+	pcre2_stl_string pattern;
+	const char *mode;
+	match_stats::snapshot stats;
+};
+
+#define pcre2_regex_top_stats PCRE2_RENAME(pcre2_regex_top_stats)
+
+// Statistics of the live regexes that have been called with stats enabled, most time spent first. At most limit entries, 0 means all.
+std::vector<pcre2_regex_stats_entry> pcre2_regex_top_stats(size_t limit = 0)
+{
+	std::vector<pcre2_regex_stats_entry> entries;
+	pcre2_regex_registry::instance().for_each([&](const pcre2_regex &reg) {
+		match_stats::snapshot s = reg.stats.read();
+		if (s.calls > 0)
+			entries.push_back({reg.pattern, reg.mode(), s});
+	});
+	std::sort(entries.begin(), entries.end(), [](const pcre2_regex_stats_entry &a, const pcre2_regex_stats_entry &b) {
+		return a.stats.nanoseconds > b.stats.nanoseconds;
+	});
+	if (limit > 0 && entries.size() > limit)
+		entries.resize(limit);
+	return entries;
+}
+
+#define pcre2_regex_reset_stats PCRE2_RENAME(pcre2_regex_reset_stats)
+
+void pcre2_regex_reset_stats()
+{
+	pcre2_regex_registry::instance().for_each([](const pcre2_regex &reg) {
+		reg.stats.reset();
+	});
+}
+
+#define pcre2_regex_bundle PCRE2_RENAME(pcre2_regex_bundle)
+
+// Precompiled patterns in one blob, so that startup decodes instead of compiling.
+// Layout: header, then per pattern its configuration and text, then the pcre2_serialize_encode output.
+// A bundle only loads into the same PCRE2 version, code unit width and byte order it was saved with.
+struct pcre2_regex_bundle {
+	// "CSRX" when read back in the byte order it was written in
+	static constexpr uint32_t magic = 0x58525343;
+	static constexpr uint32_t format_version = 2;
+	static constexpr uint32_t flag_jit = 1;
+	static constexpr uint32_t flag_no_utf_check = 2;
+	static constexpr uint32_t flag_dfa = 4;
+
+	struct header_type {
+		uint32_t magic;
+		uint32_t format_version;
+		uint32_t pcre2_major;
+		uint32_t pcre2_minor;
+		uint32_t code_unit_width;
+		uint32_t count;
+		// Bytes following the header and FNV-1a hash over them
+		uint64_t payload_size;
+		uint64_t checksum;
+	};
+
+	static uint64_t checksum(const char *data, size_t size)
+	{
+		uint64_t h = 0xcbf29ce484222325ULL;
+		for (size_t i = 0; i < size; ++i)
+			h = (h ^ static_cast<unsigned char>(data[i])) * 0x100000001b3ULL;
+		return h;
+	}
+
+	template <typename T>
+	static void put(std::string &out, const T &value)
+	{
+		out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+	}
+
+	template <typename T>
+	static T get(std::string_view data, size_t &pos)
+	{
+		if (data.size() - pos < sizeof(T))
+			throw std::runtime_error("Regex bundle is truncated");
+		T value;
+		std::memcpy(&value, data.data() + pos, sizeof(T));
+		pos += sizeof(T);
+		return value;
+	}
+
+	static std::string save(const std::vector<pcre2_regex_t> &regs)
+	{
+		std::vector<const pcre2_code *> codes;
+		codes.reserve(regs.size());
+		std::string payload;
+		for (auto &reg : regs) {
+			codes.push_back(reg->code);
+			put<uint32_t>(payload, reg->config.options);
+			put<uint32_t>(payload, reg->config.newline);
+			put<uint32_t>(payload, (reg->config.jit ? flag_jit : 0) | (reg->config.no_utf_check ? flag_no_utf_check : 0) | (reg->config.dfa ? flag_dfa : 0));
+			put<uint32_t>(payload, reg->config.match_limit);
+			put<uint32_t>(payload, reg->config.depth_limit);
+			put<uint32_t>(payload, reg->config.heap_limit);
+			put<uint64_t>(payload, reg->pattern.size());
+			payload.append(reinterpret_cast<const char *>(reg->pattern.data()), reg->pattern.size() * sizeof(PCRE2_UCHAR));
+		}
+		if (!codes.empty()) {
+			uint8_t *bytes = nullptr;
+			PCRE2_SIZE size = 0;
+			if (pcre2_serialize_encode(codes.data(), static_cast<int32_t>(codes.size()), &bytes, &size, nullptr) < 0)
+				throw std::runtime_error("Regex bundle encoding failed");
+			payload.append(reinterpret_cast<const char *>(bytes), size);
+			pcre2_serialize_free(bytes);
+		}
+		header_type header{magic, format_version, PCRE2_MAJOR, PCRE2_MINOR, PCRE2_CODE_UNIT_WIDTH,
+		                   static_cast<uint32_t>(regs.size()), payload.size(), checksum(payload.data(), payload.size())};
+		std::string out;
+		put(out, header);
+		out.append(payload);
+		return out;
+	}
+
+	// Every check happens before pcre2_serialize_decode sees the bytes, it trusts its input
+	static std::vector<pcre2_regex_t> load(std::string_view data)
+	{
+		size_t pos = 0;
+		header_type header = get<header_type>(data, pos);
+		if (header.magic != magic)
+			throw std::runtime_error("Not a regex bundle or saved with a different byte order");
+		if (header.format_version != format_version)
+			throw std::runtime_error("Unsupported regex bundle format version");
+		if (header.pcre2_major != PCRE2_MAJOR || header.pcre2_minor != PCRE2_MINOR)
+			throw std::runtime_error("Regex bundle was saved by a different PCRE2 version");
+		if (header.code_unit_width != PCRE2_CODE_UNIT_WIDTH)
+			throw std::runtime_error("Regex bundle was saved for a different code unit width");
+		if (header.payload_size != data.size() - pos || header.checksum != checksum(data.data() + pos, data.size() - pos))
+			throw std::runtime_error("Regex bundle is corrupted");
+
+		struct record {
+			pcre2_regex_config config;
+			pcre2_stl_string pattern;
+		};
+		if (header.count > data.size() - pos)
+			throw std::runtime_error("Regex bundle is truncated");
+		std::vector<record> records(header.count);
+		for (auto &r : records) {
+			r.config.options = get<uint32_t>(data, pos);
+			r.config.newline = get<uint32_t>(data, pos);
+			uint32_t flags = get<uint32_t>(data, pos);
+			r.config.jit = (flags & flag_jit) != 0;
+			r.config.no_utf_check = (flags & flag_no_utf_check) != 0;
+			r.config.dfa = (flags & flag_dfa) != 0;
+			r.config.match_limit = get<uint32_t>(data, pos);
+			r.config.depth_limit = get<uint32_t>(data, pos);
+			r.config.heap_limit = get<uint32_t>(data, pos);
+			uint64_t length = get<uint64_t>(data, pos);
+			if (length > (data.size() - pos) / sizeof(PCRE2_UCHAR))
+				throw std::runtime_error("Regex bundle is truncated");
+			r.pattern.resize(length);
+			std::memcpy(&r.pattern[0], data.data() + pos, length * sizeof(PCRE2_UCHAR));
+			pos += length * sizeof(PCRE2_UCHAR);
+		}
+
+		std::vector<pcre2_regex_t> regs;
+		if (records.empty())
+			return regs;
+		const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data.data() + pos);
+		if (pcre2_serialize_get_number_of_codes(bytes) != static_cast<int32_t>(records.size()))
+			throw std::runtime_error("Regex bundle is corrupted");
+		std::vector<pcre2_code *> codes(records.size(), nullptr);
+		if (pcre2_serialize_decode(codes.data(), static_cast<int32_t>(codes.size()), bytes, nullptr) < 0)
+			throw std::runtime_error("Regex bundle decoding failed");
+		regs.reserve(records.size());
+		try {
+			for (size_t i = 0; i < records.size(); ++i) {
+				regs.push_back(std::make_shared<pcre2_regex>(records[i].pattern, records[i].config, codes[i]));
+				codes[i] = nullptr;
+			}
+		}
+		catch (...) {
+			for (auto code : codes)
+				pcre2_code_free(code);
+			throw;
+		}
+		return regs;
+	}
+};
+
 #define pcre2_regex_match PCRE2_RENAME(pcre2_regex_match)
 
-pcre2_smatch pcre2_regex_match(pcre2_regex_t &reg, pcre2_stl_string_view input, uint32_t option)
+// Matches input in place. The result has group offsets but no subject to read the groups from, callers
+// hand it one if it matched; that way a miss never allocates.
+pcre2_smatch pcre2_regex_match(pcre2_regex_t &reg, pcre2_stl_string_view input, uint32_t option, size_t start = 0)
 {
-	pcre2_smatch result(input);
-	PCRE2_SPTR input_sptr = reinterpret_cast<PCRE2_SPTR>(input.data());
-
-	int rc = pcre2_match(
-	             reg->code,
-	             input_sptr,
-	             result.input.size(),
-	             0, // start offset
-	             option,
-	             reg->match_data,
-	             reg->match_ctx);
+	pcre2_smatch result;
+
+	if (start > input.size())
+		return result;
+
+	pcre2_match_data *match_data = reg->match_data();
+
+	int rc = reg->exec(reinterpret_cast<PCRE2_SPTR>(input.data()), input.size(), start, option, match_data);
 
 	if (rc > 0) {
-		PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(reg->match_data);
-		for (int i = 0; i < rc; ++i) {
-			PCRE2_SIZE start = ovector[2 * i];
-			PCRE2_SIZE end = ovector[2 * i + 1];
-			result.offsets.emplace_back(start, end);
-			result.groups.emplace_back(reinterpret_cast<const pcre2_stl_string::value_type *>(input_sptr + start), end - start);
-		}
-		result.ready = true;
+		result.assign(*reg, pcre2_get_ovector_pointer(match_data), rc);
 	}
 
 	return result;
 }
 
-#define pcre2_regex_replace PCRE2_RENAME(pcre2_regex_replace)
+pcre2_smatch pcre2_regex_match(pcre2_regex_t &reg, const pcre2_smatch::subject_t &subject, uint32_t option, size_t start = 0)
+{
+	pcre2_smatch result = pcre2_regex_match(reg, subject.view(), option, start);
+	if (result.ready)
+		result.subject = subject;
+	return result;
+}
+
+#define pcre2_regex_find_pos PCRE2_RENAME(pcre2_regex_find_pos)
+
+// Start and end of the first match at or after start, both PCRE2_UNSET when there is none.
+// Only the thread's match data is touched, nothing is allocated.
+std::pair<size_t, size_t> pcre2_regex_find_pos(const pcre2_regex &reg, pcre2_stl_string_view input, size_t start = 0, uint32_t option = 0)
+{
+	if (start > input.size())
+		return {PCRE2_UNSET, PCRE2_UNSET};
+	pcre2_match_data *match_data = reg.match_data();
+	if (reg.exec(reinterpret_cast<PCRE2_SPTR>(input.data()), input.size(), start, option, match_data) <= 0)
+		return {PCRE2_UNSET, PCRE2_UNSET};
+	PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(match_data);
+	return {ovector[0], ovector[1]};
+}
+
+#define pcre2_regex_search_batch PCRE2_RENAME(pcre2_regex_search_batch)
+
+// Runs one pattern over many subjects on the worker pool, each worker with its own match data and JIT stack.
+// positions[i] is the start of the first match in subjects[i], or PCRE2_UNSET when there is none.
+void pcre2_regex_search_batch(const pcre2_regex &reg, const std::vector<pcre2_stl_string_view> &subjects, uint32_t option, size_t threads, std::vector<PCRE2_SIZE> &positions)
+{
+	positions.assign(subjects.size(), PCRE2_UNSET);
+	parallel_pool::instance().for_each(subjects.size(), threads, 64, [&](size_t begin, size_t end) {
+		pcre2_match_data *match_data = reg.match_data();
+		PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(match_data);
+		for (size_t i = begin; i < end; ++i) {
+			if (reg.exec(reinterpret_cast<PCRE2_SPTR>(subjects[i].data()), subjects[i].size(), 0, option, match_data) > 0)
+				positions[i] = ovector[0];
+		}
+	});
+}
+
+#define pcre2_regex_scanner PCRE2_RENAME(pcre2_regex_scanner)
+
+// Finds successive non-overlapping matches following the rules of pcre2demo: after an empty match the
+// next attempt must be non-empty at the same position, failing that the scan moves on by one character
+// (or over a CRLF pair when CRLF is a valid newline).
+// The ovector is left in the caller's match data, so read it before matching anything else on the thread.
+struct pcre2_regex_scanner {
+	const pcre2_regex *reg;
+	PCRE2_SPTR subject;
+	size_t length;
+	size_t offset;
+	uint32_t option = 0;
+	// Passed on every attempt, e.g. PCRE2_NOTEOL when the subject is a slice of a longer one
+	uint32_t base_option = 0;
+	// Becomes PCRE2_NO_UTF_CHECK once the first attempt has validated the rest of the subject
+	uint32_t utf_checked = 0;
+	bool done = false;
+	// Set to the pcre2_match error code when scanning stopped on an error other than no match
+	int error = 0;
+
+	pcre2_regex_scanner(const pcre2_regex &reg_v, pcre2_stl_string_view input, size_t start = 0)
+		: reg(&reg_v), subject(reinterpret_cast<PCRE2_SPTR>(input.data())), length(input.size()), offset(start) {}
+
+	// Returns the pcre2_match result code, PCRE2_ERROR_NOMATCH once the subject is exhausted
+	int next(pcre2_match_data *match_data)
+	{
+		while (!done && offset <= length) {
+			int rc = reg->exec(subject, length, offset, base_option | option | utf_checked, match_data);
+			if (rc >= 0 || rc == PCRE2_ERROR_NOMATCH)
+				utf_checked = PCRE2_NO_UTF_CHECK;
+			if (rc == PCRE2_ERROR_NOMATCH && option != 0) {
+				option = 0;
+				offset = reg->advance(subject, length, offset);
+				continue;
+			}
+			if (rc < 0) {
+				if (rc != PCRE2_ERROR_NOMATCH)
+					error = rc;
+				break;
+			}
+			PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(match_data);
+			option = ovector[0] == ovector[1] ? PCRE2_NOTEMPTY_ATSTART | PCRE2_ANCHORED : 0;
+			offset = ovector[1];
+			return rc;
+		}
+		done = true;
+		return PCRE2_ERROR_NOMATCH;
+	}
+};
+
+#define pcre2_regex_count PCRE2_RENAME(pcre2_regex_count)
+
+// Number of non-overlapping matches, as find_all would return them
+size_t pcre2_regex_count(const pcre2_regex &reg, pcre2_stl_string_view input)
+{
+	pcre2_match_data *match_data = reg.match_data();
+	pcre2_regex_scanner scanner(reg, input);
+	size_t count = 0;
+	while (scanner.next(match_data) > 0)
+		++count;
+	return count;
+}
+
+#define pcre2_regex_find_all PCRE2_RENAME(pcre2_regex_find_all)
+
+// Every non-overlapping match, without a subject like the results of pcre2_regex_match on a view
+std::vector<pcre2_smatch> pcre2_regex_find_all(const pcre2_regex &reg, pcre2_stl_string_view input)
+{
+	std::vector<pcre2_smatch> results;
+	pcre2_match_data *match_data = reg.match_data();
+	pcre2_regex_scanner scanner(reg, input);
+	int rc;
+	while ((rc = scanner.next(match_data)) > 0) {
+		results.emplace_back();
+		results.back().assign(reg, pcre2_get_ovector_pointer(match_data), rc);
+	}
+	return results;
+}
+
+#define pcre2_regex_iterator PCRE2_RENAME(pcre2_regex_iterator)
+
+// Lazy cursor over all matches of a regex in a shared subject. The subject is checked before every step,
+// so changing the string between steps raises an error instead of scanning freed memory.
+struct pcre2_regex_iterator {
+	pcre2_regex_t reg;
+	pcre2_smatch::subject_t subject;
+	pcre2_regex_scanner scanner;
+	pcre2_smatch current;
+
+	pcre2_regex_iterator(pcre2_regex_t reg_v, pcre2_smatch::subject_t subject_v, size_t start = 0)
+		: reg(std::move(reg_v)), subject(std::move(subject_v)), scanner(*reg, subject.view(), start) {}
+
+	bool next()
+	{
+		current = pcre2_smatch();
+		subject.check();
+		pcre2_match_data *match_data = reg->match_data();
+		int rc = scanner.next(match_data);
+		if (rc <= 0)
+			return false;
+		current.subject = subject;
+		current.assign(*reg, pcre2_get_ovector_pointer(match_data), rc);
+		return true;
+	}
+};
+
+#define pcre2_regex_parallel PCRE2_RENAME(pcre2_regex_parallel)
+
+// Searches one large subject with all cores. The subject is cut into chunks that the worker pool scans
+// concurrently, then the results are merged back in subject order.
+// With overlap == 0 chunks end after a record separator and matches are expected not to cross records.
+// Otherwise chunks are fixed windows extended by overlap code units, which must be at least the longest
+// possible match. Either way every match is found with the real text before it visible to lookbehinds.
+// Results hold no subject, as with pcre2_regex_match on a view.
+class pcre2_regex_parallel {
+	struct chunk {
+		// Matches are reported when they start in [begin, end), the scan sees the subject up to limit
+		size_t begin, end, limit;
+	};
 
-pcre2_stl_string pcre2_regex_replace(pcre2_regex_t &reg, pcre2_stl_string_view input, pcre2_stl_string_view fmt)
+	pcre2_regex_t reg;
+	// The pattern asserts where the subject ends or where the scan started, so chunks would disagree with
+	// a sequential scan and the subject is scanned as one chunk
+	bool whole_subject;
+
+	// \z and \Z see the end of a truncated chunk as the end of the subject, which PCRE2_NOTEOL does not
+	// prevent, and \G matches at every chunk start. Escapes inside \Q...\E count too, which is harmless.
+	static bool uses_position_escapes(const pcre2_regex &reg)
+	{
+		if (reg.config.options & PCRE2_LITERAL)
+			return false;
+		const pcre2_stl_string &p = reg.pattern;
+		for (size_t i = 0; i + 1 < p.size(); ++i) {
+			if (p[i] != '\\')
+				continue;
+			++i;
+			if (p[i] == 'z' || p[i] == 'Z' || p[i] == 'G')
+				return true;
+		}
+		return false;
+	}
+
+	// First boundary at or after pos where a sequential scan may start a match: windows must not cut a
+	// UTF character or a CRLF newline in half
+	size_t align(PCRE2_SPTR subject, size_t length, size_t pos) const
+	{
+		if (reg->crlf_newline && pos > 0 && pos < length && subject[pos - 1] == '\r' && subject[pos] == '\n')
+			++pos;
+		if (reg->utf) {
+#if PCRE2_CODE_UNIT_WIDTH == 8
+			while (pos < length && (subject[pos] & 0xC0) == 0x80)
+				++pos;
+#elif PCRE2_CODE_UNIT_WIDTH == 16
+			while (pos < length && (subject[pos] & 0xFC00) == 0xDC00)
+				++pos;
+#endif
+		}
+		return std::min(pos, length);
+	}
+
+	std::vector<chunk> plan(PCRE2_SPTR subject, size_t length, size_t workers) const
+	{
+		std::vector<chunk> chunks;
+		if (whole_subject) {
+			chunks.push_back({0, length, length});
+			return chunks;
+		}
+		// A few chunks per worker so that one slow chunk does not hold up the rest
+		size_t target = std::max(min_chunk, length / (workers * 4) + 1);
+		for (size_t pos = 0; pos < length || chunks.empty();) {
+			size_t end = align(subject, length, std::min(length - pos, target) + pos);
+			size_t limit = end;
+			if (overlap == 0) {
+				while (end < length && subject[end - 1] != separator)
+					++end;
+				limit = end;
+			}
+			else if (end < length) {
+				limit = align(subject, length, std::min(length - end, overlap) + end);
+			}
+			chunks.push_back({pos, end, limit});
+			pos = end;
+		}
+		return chunks;
+	}
+
+	void scan(const chunk &c, pcre2_stl_string_view input, size_t from, bool first_only, std::vector<pcre2_smatch> &out) const
+	{
+		size_t length = input.size();
+		pcre2_match_data *match_data = reg->match_data();
+		pcre2_regex_scanner scanner(*reg, input.substr(0, c.limit), from);
+		if (c.limit < length)
+			scanner.base_option = PCRE2_NOTEOL;
+		int rc;
+		while ((rc = scanner.next(match_data)) > 0) {
+			PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(match_data);
+			// Starts inside the next chunk, which reports it itself
+			if (ovector[0] >= c.end && c.end < length)
+				break;
+			pcre2_smatch m;
+			m.assign(*reg, ovector, rc);
+			out.push_back(std::move(m));
+			if (first_only)
+				break;
+		}
+		if (scanner.error != 0)
+			throw std::runtime_error("PCRE2 match failed");
+	}
+
+public:
+	size_t overlap;
+	size_t threads;
+	PCRE2_UCHAR separator = '\n';
+	size_t min_chunk = 64 * 1024;
+
+	pcre2_regex_parallel(pcre2_regex_t reg_v, size_t overlap_v = 0, size_t threads_v = 0)
+		: reg(std::move(reg_v)), whole_subject(uses_position_escapes(*reg)), overlap(overlap_v), threads(threads_v) {}
+
+	std::vector<pcre2_smatch> find_all(pcre2_stl_string_view input) const
+	{
+		size_t workers = parallel_pool::resolve_threads(threads);
+		std::vector<chunk> chunks = plan(reinterpret_cast<PCRE2_SPTR>(input.data()), input.size(), workers);
+		std::vector<std::vector<pcre2_smatch>> parts(chunks.size());
+		parallel_pool::instance().for_each(chunks.size(), workers, 1, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i)
+				scan(chunks[i], input, chunks[i].begin, false, parts[i]);
+		});
+		std::vector<pcre2_smatch> results;
+		size_t last_end = 0;
+		for (size_t i = 0; i < parts.size(); ++i) {
+			// A match from the previous window ran past the start of this one's first match, so this window
+			// is scanned again from where a sequential scan would resume
+			if (!parts[i].empty() && parts[i].front().offsets[0].first < last_end) {
+				parts[i].clear();
+				scan(chunks[i], input, last_end, false, parts[i]);
+			}
+			for (auto &m : parts[i]) {
+				last_end = std::max(last_end, m.offsets[0].second);
+				results.push_back(std::move(m));
+			}
+		}
+		return results;
+	}
+
+	// Leftmost match, chunks after one that already matched are skipped
+	pcre2_smatch search(pcre2_stl_string_view input) const
+	{
+		size_t workers = parallel_pool::resolve_threads(threads);
+		std::vector<chunk> chunks = plan(reinterpret_cast<PCRE2_SPTR>(input.data()), input.size(), workers);
+		std::vector<std::vector<pcre2_smatch>> parts(chunks.size());
+		std::atomic<size_t> found{chunks.size()};
+		parallel_pool::instance().for_each(chunks.size(), workers, 1, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end && i < found.load(); ++i) {
+				scan(chunks[i], input, chunks[i].begin, true, parts[i]);
+				if (parts[i].empty())
+					continue;
+				size_t current = found.load();
+				while (i < current && !found.compare_exchange_weak(current, i));
+			}
+		});
+		for (auto &part : parts) {
+			if (!part.empty())
+				return std::move(part.front());
+		}
+		return pcre2_smatch();
+	}
+};
+
+#define pcre2_replace_option PCRE2_RENAME(pcre2_replace_option)
+
+// Script level replace flags: 1 replaces the first match only, 2 inserts the replacement literally without $ expansion
+uint32_t pcre2_replace_option(uint32_t flags)
+{
+	uint32_t option = (flags & 1) ? 0 : PCRE2_SUBSTITUTE_GLOBAL;
+	if (flags & 2)
+		option |= PCRE2_SUBSTITUTE_LITERAL;
+	return option;
+}
+
+#define pcre2_regex_replace_to PCRE2_RENAME(pcre2_regex_replace_to)
+
+// Appends the substituted text to out and returns the number of replacements.
+// pcre2_substitute writes into the thread's scratch buffer, which is only grown (to the exact size reported
+// through PCRE2_SUBSTITUTE_OVERFLOW_LENGTH) when the output does not fit, so most calls run exactly once.
+// pcre2_substitute only has the backtracking matcher, so a DFA mode regex replaces its leftmost-first matches
+// here rather than the longest ones its searches return; replace_with goes through exec and keeps DFA mode.
+int pcre2_regex_replace_to(pcre2_regex_t &reg, pcre2_stl_string_view input, pcre2_stl_string_view fmt, pcre2_stl_string &out, uint32_t option = PCRE2_SUBSTITUTE_GLOBAL)
 {
-	pcre2_stl_string out(input.size() * 2, '\0');
-	PCRE2_SIZE out_len = out.size();
-
-	int rc = pcre2_substitute(
-	             reg->code,
-	             reinterpret_cast<PCRE2_SPTR>(input.data()),
-	             input.size(),
-	             0,
-	             PCRE2_SUBSTITUTE_GLOBAL,
-	             reg->match_data,
-	             reg->match_ctx,
-	             reinterpret_cast<PCRE2_SPTR>(fmt.data()),
-	             fmt.size(),
-	             reinterpret_cast<PCRE2_UCHAR *>(&out[0]),
-	             &out_len);
-
-	if (rc == PCRE2_ERROR_NOMEMORY) {
-		out.resize(out_len);
+	// Without the required literal there is nothing to replace and the input is copied as is
+	if (reg->prefilter_rejects(input, 0, option)) {
+		const match_stats::clock::time_point begin = match_stats::start();
+		if (begin != match_stats::clock::time_point())
+			reg->record_stats(begin, input.size() * sizeof(PCRE2_UCHAR), false, false, match_stats::prefilter);
+		out.append(input);
+		return 0;
+	}
+
+	pcre2_match_state &state = pcre2_match_state::local();
+	pcre2_match_data *match_data = state.acquire(reg->capture_count + 1);
+	std::vector<PCRE2_UCHAR> &buffer = state.buffer;
+
+	if (buffer.size() < input.size() + fmt.size() + 1)
+		buffer.resize(input.size() + input.size() / 4 + fmt.size() + 1);
+
+	const match_stats::clock::time_point begin = match_stats::start();
+	int rc = PCRE2_ERROR_NOMEMORY;
+	PCRE2_SIZE out_len = 0;
+	reg->prepare();
+	for (int attempt = 0; attempt < 2 && rc == PCRE2_ERROR_NOMEMORY; ++attempt) {
+		if (attempt > 0)
+			buffer.resize(out_len);
+		out_len = buffer.size();
 		rc = pcre2_substitute(
 		         reg->code,
 		         reinterpret_cast<PCRE2_SPTR>(input.data()),
 		         input.size(),
 		         0,
-		         PCRE2_SUBSTITUTE_GLOBAL,
-		         reg->match_data,
+		         option | reg->match_options | PCRE2_SUBSTITUTE_OVERFLOW_LENGTH,
+		         match_data,
 		         reg->match_ctx,
 		         reinterpret_cast<PCRE2_SPTR>(fmt.data()),
 		         fmt.size(),
-		         reinterpret_cast<PCRE2_UCHAR *>(&out[0]),
+		         buffer.data(),
 		         &out_len);
 	}
 
+	// One call per replace
+	if (begin != match_stats::clock::time_point())
+		reg->record_stats(begin, input.size() * sizeof(PCRE2_UCHAR), rc > 0, pcre2_regex::limit_error(rc),
+		                  reg->config.jit ? match_stats::jit : match_stats::interpreter);
+
 	if (rc < 0)
 		throw std::runtime_error("Regex replace failed");
 
-	out.resize(out_len);
+	out.append(reinterpret_cast<const pcre2_stl_string::value_type *>(buffer.data()), out_len);
+	state.trim_buffer();
+	return rc;
+}
+
+#define pcre2_regex_replace PCRE2_RENAME(pcre2_regex_replace)
+
+pcre2_stl_string pcre2_regex_replace(pcre2_regex_t &reg, pcre2_stl_string_view input, pcre2_stl_string_view fmt, uint32_t option = PCRE2_SUBSTITUTE_GLOBAL)
+{
+	pcre2_stl_string out;
+	pcre2_regex_replace_to(reg, input, fmt, out, option);
 	return out;
-}
\ No newline at end of file
+}
+
+#define pcre2_regex_replace_with PCRE2_RENAME(pcre2_regex_replace_with)
+
+// Builds the output in one pass, fn(match, out) appends the replacement for each match. The matches share
+// the subject that share() returns for input, which is only asked for at the first match.
+// Offsets are copied out of the match data before fn runs, so fn may run other regexes; it must not change
+// the subject, which is checked after every call.
+template <typename S, typename F>
+pcre2_stl_string pcre2_regex_replace_with(pcre2_regex_t &reg, pcre2_stl_string_view input, S &&share, F &&fn)
+{
+	pcre2_stl_string out;
+	out.reserve(input.size());
+	size_t last = 0;
+	pcre2_smatch::subject_t subject;
+	pcre2_regex_scanner scanner(*reg, input);
+	for (;;) {
+		// fn may have grown the thread's match data for a pattern with more groups
+		pcre2_match_data *match_data = reg->match_data();
+		int rc = scanner.next(match_data);
+		if (rc <= 0)
+			break;
+		if (!subject)
+			subject = share();
+		pcre2_smatch m(subject);
+		m.assign(*reg, pcre2_get_ovector_pointer(match_data), rc);
+		auto [start, end] = m.offsets[0];
+		if (start > last)
+			out.append(input.substr(last, start - last));
+		fn(m, out);
+		subject.check();
+		last = std::max(last, end);
+	}
+	if (last < input.size())
+		out.append(input.substr(last));
+	return out;
+}
+
+#define pcre2_regex_split PCRE2_RENAME(pcre2_regex_split)
+
+// Collects the spans of a split in one pass: the text between matches, interleaved with the captured
+// groups of each delimiter (unset groups are reported as PCRE2_UNSET). At most limit splits are made,
+// 0 means no limit.
+void pcre2_regex_split(const pcre2_regex &reg, pcre2_stl_string_view input, size_t limit, std::vector<std::pair<size_t, size_t>> &pieces)
+{
+	pieces.clear();
+	pcre2_match_data *match_data = reg.match_data();
+	pcre2_regex_scanner scanner(reg, input);
+	size_t last = 0, splits = 0;
+	int rc;
+	while ((limit == 0 || splits < limit) && (rc = scanner.next(match_data)) > 0) {
+		// The scanner resumes at the previous match end and exec rejects matches ending before their start,
+		// so last <= ovector[0] <= ovector[1]
+		PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(match_data);
+		pieces.emplace_back(last, ovector[0]);
+		for (int i = 1; i < rc; ++i)
+			pieces.emplace_back(ovector[2 * i], ovector[2 * i + 1]);
+		for (uint32_t i = rc; i <= reg.capture_count; ++i)
+			pieces.emplace_back(PCRE2_UNSET, PCRE2_UNSET);
+		last = ovector[1];
+		++splits;
+	}
+	pieces.emplace_back(last, input.size());
+}
+
+// Longest run of literal code units that every match of the pattern must contain, or empty if none
+// can be proven. Only the top level of the pattern is analysed; alternation at the top level, case
+// insensitivity, extended syntax and \Q...\E give up rather than risk rejecting a subject that matches.
+pcre2_stl_string pcre2_required_literal(const pcre2_regex &reg)
+{
+	using char_type = pcre2_stl_string::value_type;
+	const pcre2_stl_string &p = reg.pattern;
+	const size_t n = p.size();
+
+	uint32_t options = 0;
+	pcre2_pattern_info(reg.code, PCRE2_INFO_ALLOPTIONS, &options);
+	if (options & (PCRE2_CASELESS | PCRE2_EXTENDED | PCRE2_EXTENDED_MORE))
+		return pcre2_stl_string();
+	if (options & PCRE2_LITERAL)
+		return p;
+
+	auto is_digit = [](char_type c) {
+		return c >= '0' && c <= '9';
+	};
+	auto is_alnum = [&](char_type c) {
+		return is_digit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+	};
+	// Length of a quantifier starting at i (0 if there is none), min_zero tells whether it allows zero repeats
+	auto quantifier = [&](size_t i, bool &min_zero) -> size_t {
+		if (i >= n)
+			return 0;
+		size_t j = i;
+		if (p[j] == '*' || p[j] == '?' || p[j] == '+') {
+			min_zero = p[j] != '+';
+			++j;
+		}
+		else if (p[j] == '{') {
+			size_t k = j + 1, digits = 0;
+			bool zero = true;
+			while (k < n && is_digit(p[k])) {
+				zero = zero && p[k] == '0';
+				++k, ++digits;
+			}
+			bool comma = k < n && p[k] == ',';
+			if (comma)
+				++k;
+			while (k < n && is_digit(p[k])) ++k;
+			if (k >= n || p[k] != '}' || (digits == 0 && !comma))
+				return 0;
+			min_zero = zero;
+			j = k + 1;
+		}
+		else
+			return 0;
+		if (j < n && (p[j] == '+' || p[j] == '?'))
+			++j;
+		return j - i;
+	};
+	// Index just past the character class opened at i
+	auto skip_class = [&](size_t i) -> size_t {
+		size_t j = i + 1;
+		if (j < n && p[j] == '^')
+			++j;
+		if (j < n && p[j] == ']')
+			++j;
+		while (j < n && p[j] != ']') {
+			if (p[j] == '\\')
+				j += 2;
+			else if (p[j] == '[' && j + 1 < n && p[j + 1] == ':') {
+				size_t k = j + 2;
+				while (k + 1 < n && !(p[k] == ':' && p[k + 1] == ']')) ++k;
+				j = k + 2;
+			}
+			else
+				++j;
+		}
+		return j + 1;
+	};
+	// Index just past the escape sequence starting at i
+	auto skip_escape = [&](size_t i) -> size_t {
+		size_t j = i + 2;
+		if (j > n)
+			return n;
+		char_type c = p[i + 1];
+		if (j < n && p[j] == '{' && (c == 'x' || c == 'o' || c == 'p' || c == 'P' || c == 'N' || c == 'g' || c == 'k')) {
+			while (j < n && p[j] != '}') ++j;
+			return j + 1;
+		}
+		if (j < n && (c == 'k' || c == 'g') && (p[j] == '<' || p[j] == '\'')) {
+			char_type close = p[j] == '<' ? '>' : '\'';
+			while (j < n && p[j] != close) ++j;
+			return j + 1;
+		}
+		if (c == 'x')
+			while (j < n && j < i + 4 && ((p[j] >= '0' && p[j] <= '9') || (p[j] >= 'a' && p[j] <= 'f') || (p[j] >= 'A' && p[j] <= 'F'))) ++j;
+		else if (c == 'c' && j < n)
+			++j;
+		return j;
+	};
+
+	pcre2_stl_string best, cur;
+	auto flush = [&]() {
+		if (cur.size() > best.size())
+			best = cur;
+		cur.clear();
+	};
+
+	size_t i = 0;
+	while (i < n) {
+		char_type c = p[i];
+		if (c == '|' || c == ')')
+			return pcre2_stl_string();
+		if (c == '(') {
+			flush();
+			if (i + 2 < n && p[i + 1] == '?') {
+				// Inline option settings such as (?i) or (?x) change how the rest is matched
+				for (size_t k = i + 2; k < n && p[k] != ')' && p[k] != ':'; ++k) {
+					if (p[k] == 'i' || p[k] == 'x')
+						return pcre2_stl_string();
+					if (!(p[k] >= 'a' && p[k] <= 'z') && !(p[k] >= 'A' && p[k] <= 'Z') && p[k] != '-' && p[k] != '^')
+						break;
+				}
+			}
+			size_t depth = 0, j = i;
+			for (; j < n; ++j) {
+				if (p[j] == '\\') {
+					if (j + 1 < n && p[j + 1] == 'Q')
+						return pcre2_stl_string();
+					++j;
+				}
+				else if (p[j] == '[')
+					j = skip_class(j) - 1;
+				else if (p[j] == '(')
+					++depth;
+				else if (p[j] == ')' && --depth == 0)
+					break;
+			}
+			bool min_zero = false;
+			i = j + 1;
+			i += quantifier(i, min_zero);
+			continue;
+		}
+		size_t next;
+		bool literal = false;
+		if (c == '\\') {
+			if (i + 1 >= n)
+				return pcre2_stl_string();
+			char_type e = p[i + 1];
+			if (e == 'Q')
+				return pcre2_stl_string();
+			if (!is_alnum(e) && static_cast<uint32_t>(e) < 0x80) {
+				c = e;
+				literal = true;
+			}
+			next = skip_escape(i);
+		}
+		else if (c == '[')
+			next = skip_class(i);
+		else if (c == '.' || c == '^' || c == '$')
+			next = i + 1;
+		else {
+			literal = true;
+			next = i + 1;
+#if PCRE2_CODE_UNIT_WIDTH == 8
+			// A quantifier after a multi-byte character applies to the whole character
+			if (reg.utf && (static_cast<unsigned char>(c) & 0xc0) == 0xc0)
+				while (next < n && (static_cast<unsigned char>(p[next]) & 0xc0) == 0x80) ++next;
+#endif
+		}
+		bool min_zero = false;
+		size_t q = quantifier(next, min_zero);
+		if (!literal) {
+			flush();
+		}
+		else if (q > 0 && min_zero) {
+			flush();
+		}
+		else {
+			if (p[i] == '\\')
+				cur.push_back(c);
+			else
+				cur.append(p, i, next - i);
+			if (q > 0)
+				flush();
+		}
+		i = next + q;
+	}
+	flush();
+	return best;
+}
+
+#define pcre2_regex_set PCRE2_RENAME(pcre2_regex_set)
+
+// Matches many patterns against one subject. Every pattern contributes the literal it cannot match
+// without (see pcre2_required_literal) plus its first and last code unit from pcre2_pattern_info.
+// A single pass over the subject runs an Aho-Corasick automaton over all literals and records which
+// code units occur; patterns whose requirements are missing are rejected without being run.
+class pcre2_regex_set {
+	using char_type = pcre2_stl_string::value_type;
+
+	static constexpr size_t filter_bits = PCRE2_CODE_UNIT_WIDTH == 8 ? 256 : 4096;
+
+	struct entry_type {
+		pcre2_regex_t reg;
+		std::vector<uint32_t> units;
+		ptrdiff_t literal = -1;
+		bool anchored = false;
+		bool has_first = false;
+		uint32_t first = 0;
+	};
+
+	struct node_type {
+		// Sorted by code unit
+		std::vector<std::pair<uint32_t, uint32_t>> edges;
+		uint32_t fail = 0;
+		// Next node on the failure chain that ends a literal, 0 if none
+		uint32_t dict = 0;
+		ptrdiff_t literal = -1;
+	};
+
+	std::vector<entry_type> entries;
+	std::vector<pcre2_stl_string> literals;
+	// Id of each distinct literal, so that adding patterns stays linear
+	std::unordered_map<pcre2_stl_string, size_t> literal_ids;
+	std::vector<node_type> nodes;
+	bool automaton_ready = false;
+
+	static bool may_be_caseless(const pcre2_regex &reg)
+	{
+		uint32_t options = 0;
+		pcre2_pattern_info(reg.code, PCRE2_INFO_ALLOPTIONS, &options);
+		if (options & PCRE2_CASELESS)
+			return true;
+		// Inline option settings such as (?i) or (?m-i:...) are not reflected in ALLOPTIONS
+		const pcre2_stl_string &p = reg.pattern;
+		for (size_t i = 0; i + 2 < p.size(); ++i) {
+			if (p[i] != '(' || p[i + 1] != '?')
+				continue;
+			for (size_t j = i + 2; j < p.size() && p[j] != ')' && p[j] != ':'; ++j) {
+				if (p[j] == 'i')
+					return true;
+				if (!(p[j] >= 'a' && p[j] <= 'z') && !(p[j] >= 'A' && p[j] <= 'Z') && p[j] != '-' && p[j] != '^')
+					break;
+			}
+		}
+		return false;
+	}
+
+	static bool is_alpha(uint32_t cu)
+	{
+		return (cu >= 'a' && cu <= 'z') || (cu >= 'A' && cu <= 'Z');
+	}
+
+	static uint32_t find_edge(const node_type &node, uint32_t cu)
+	{
+		auto it = std::lower_bound(node.edges.begin(), node.edges.end(), std::make_pair(cu, uint32_t(0)));
+		if (it != node.edges.end() && it->first == cu)
+			return it->second;
+		return 0;
+	}
+
+	void build_automaton()
+	{
+		nodes.assign(1, node_type());
+		for (size_t id = 0; id < literals.size(); ++id) {
+			uint32_t cur = 0;
+			for (auto ch : literals[id]) {
+				uint32_t cu = static_cast<uint32_t>(ch);
+				uint32_t next = find_edge(nodes[cur], cu);
+				if (next == 0) {
+					next = nodes.size();
+					nodes.emplace_back();
+					auto &edges = nodes[cur].edges;
+					edges.insert(std::lower_bound(edges.begin(), edges.end(), std::make_pair(cu, uint32_t(0))), std::make_pair(cu, next));
+				}
+				cur = next;
+			}
+			nodes[cur].literal = id;
+		}
+		// Breadth first so that every failure target is complete before it is used
+		std::vector<uint32_t> queue;
+		for (auto &edge : nodes[0].edges)
+			queue.push_back(edge.second);
+		for (size_t head = 0; head < queue.size(); ++head) {
+			uint32_t cur = queue[head];
+			for (auto &edge : nodes[cur].edges) {
+				uint32_t f = nodes[cur].fail;
+				uint32_t target;
+				while ((target = find_edge(nodes[f], edge.first)) == 0 && f != 0) f = nodes[f].fail;
+				node_type &child = nodes[edge.second];
+				child.fail = target;
+				child.dict = nodes[target].literal >= 0 ? target : nodes[target].dict;
+				queue.push_back(edge.second);
+			}
+		}
+		automaton_ready = true;
+	}
+
+	struct scan_result {
+		std::vector<bool> literals;
+		std::vector<uint64_t> units;
+	};
+
+	scan_result scan(pcre2_stl_string_view input) const
+	{
+		scan_result r;
+		r.literals.assign(literals.size(), false);
+		r.units.assign(filter_bits / 64, 0);
+		uint32_t state = 0;
+		for (auto ch : input) {
+			uint32_t cu = static_cast<uint32_t>(ch);
+			r.units[(cu % filter_bits) >> 6] |= uint64_t(1) << (cu & 63);
+			if (nodes.size() > 1) {
+				uint32_t next;
+				while ((next = find_edge(nodes[state], cu)) == 0 && state != 0) state = nodes[state].fail;
+				state = next;
+				for (uint32_t k = nodes[state].literal >= 0 ? state : nodes[state].dict; k != 0 && !r.literals[nodes[k].literal]; k = nodes[k].dict)
+					r.literals[nodes[k].literal] = true;
+			}
+		}
+		return r;
+	}
+
+	bool passes(const entry_type &e, pcre2_stl_string_view input, const scan_result &r) const
+	{
+		if (e.anchored && e.has_first && (input.empty() || static_cast<uint32_t>(input[0]) != e.first))
+			return false;
+		if (e.literal >= 0 && automaton_ready && !r.literals[e.literal])
+			return false;
+		for (uint32_t cu : e.units)
+			if (!((r.units[(cu % filter_bits) >> 6] >> (cu & 63)) & 1))
+				return false;
+		return true;
+	}
+
+public:
+	void add(pcre2_regex_t reg)
+	{
+		entry_type e;
+		e.reg = std::move(reg);
+		const pcre2_regex &r = *e.reg;
+		// Case folding can map a code unit onto others (even ASCII k and s have non-ASCII folds),
+		// so letters and non-ASCII units are only used when the pattern cannot be caseless.
+		bool caseless = may_be_caseless(r);
+		auto usable = [caseless](uint32_t cu) {
+			return cu < 0x80 && !(caseless && is_alpha(cu));
+		};
+		uint32_t type = 0, unit = 0, options = 0;
+		pcre2_pattern_info(r.code, PCRE2_INFO_FIRSTCODETYPE, &type);
+		if (type == 1) {
+			pcre2_pattern_info(r.code, PCRE2_INFO_FIRSTCODEUNIT, &unit);
+			if (usable(unit)) {
+				e.units.push_back(unit);
+				e.has_first = true;
+				e.first = unit;
+			}
+		}
+		pcre2_pattern_info(r.code, PCRE2_INFO_LASTCODETYPE, &type);
+		if (type == 1) {
+			pcre2_pattern_info(r.code, PCRE2_INFO_LASTCODEUNIT, &unit);
+			if (usable(unit))
+				e.units.push_back(unit);
+		}
+		pcre2_pattern_info(r.code, PCRE2_INFO_ALLOPTIONS, &options);
+		e.anchored = (options & PCRE2_ANCHORED) != 0;
+		pcre2_stl_string literal = pcre2_required_literal(r);
+		if (literal.size() > 1) {
+			auto [it, inserted] = literal_ids.emplace(literal, literals.size());
+			e.literal = it->second;
+			if (inserted)
+				literals.emplace_back(std::move(literal));
+			automaton_ready = false;
+		}
+		entries.emplace_back(std::move(e));
+	}
+
+	// Call once all patterns are added, the set is read-only and shareable between threads afterwards
+	void prepare()
+	{
+		if (!automaton_ready)
+			build_automaton();
+	}
+
+	size_t size() const
+	{
+		return entries.size();
+	}
+
+	const pcre2_regex_t &at(size_t i) const
+	{
+		return entries.at(i).reg;
+	}
+
+	// Indexes of every pattern that matches somewhere in input, in pattern order
+	std::vector<size_t> matches(pcre2_stl_string_view input) const
+	{
+		std::vector<size_t> result;
+		scan_result r = scan(input);
+		PCRE2_SPTR subject = reinterpret_cast<PCRE2_SPTR>(input.data());
+		for (size_t i = 0; i < entries.size(); ++i) {
+			const entry_type &e = entries[i];
+			if (!passes(e, input, r))
+				continue;
+			if (e.reg->exec(subject, input.size(), 0, 0, e.reg->match_data()) > 0)
+				result.push_back(i);
+		}
+		return result;
+	}
+
+	// The match that starts earliest in input (lowest pattern index on ties), or -1 with an empty result.
+	// The result holds no subject, as with pcre2_regex_match on a view.
+	std::pair<ptrdiff_t, pcre2_smatch> first(pcre2_stl_string_view input) const
+	{
+		scan_result r = scan(input);
+		std::pair<ptrdiff_t, pcre2_smatch> best(-1, pcre2_smatch());
+		PCRE2_SPTR sptr = reinterpret_cast<PCRE2_SPTR>(input.data());
+		for (size_t i = 0; i < entries.size(); ++i) {
+			const entry_type &e = entries[i];
+			if (!passes(e, input, r))
+				continue;
+			pcre2_match_data *match_data = e.reg->match_data();
+			int rc = e.reg->exec(sptr, input.size(), 0, 0, match_data);
+			if (rc <= 0)
+				continue;
+			PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(match_data);
+			if (best.first >= 0 && ovector[0] >= best.second.offsets[0].first)
+				continue;
+			best.first = i;
+			best.second.assign(*e.reg, ovector, rc);
+			if (ovector[0] == 0)
+				break;
+		}
+		return best;
+	}
+};
+
+#define pcre2_regex_set_t PCRE2_RENAME(pcre2_regex_set_t)
+
+using pcre2_regex_set_t = std::shared_ptr<pcre2_regex_set>;
+
+#define pcre2_regex_stream PCRE2_RENAME(pcre2_regex_stream)
+
+// Matches a regex over input that arrives in chunks. Matches that reach the end of the data seen so far
+// are held back with PCRE2_PARTIAL_HARD until the next chunk decides them, and only the tail that a
+// pending match or the pattern's lookbehind can still reach is retained between chunks.
+// Results own a copy of the matched span; their positions are offsets within the whole stream.
+// Errors propagate out of feed and finish like those of any other match: exceeded limits, and matches that
+// end before their start (\K in a lookaround), which pcre2_regex::exec rejects.
+class pcre2_regex_stream {
+	pcre2_regex_t reg;
+	pcre2_stl_string buffer;
+	// Stream offset of buffer[0]
+	size_t base = 0;
+	// Buffer offset of the next match attempt
+	size_t scan_from = 0;
+	size_t lookbehind = 1;
+	uint32_t option = 0;
+	bool finished = false;
+
+	pcre2_smatch make_result(PCRE2_SIZE *ovector, int rc) const
+	{
+		size_t lo = ovector[0], hi = ovector[1];
+		for (int i = 0; i < rc; ++i) {
+			if (ovector[2 * i] == PCRE2_UNSET)
+				continue;
+			lo = std::min(lo, ovector[2 * i]);
+			hi = std::max(hi, ovector[2 * i + 1]);
+		}
+		pcre2_smatch result(std::make_shared<const pcre2_stl_string>(buffer, lo, hi - lo));
+		result.base = base + lo;
+		result.offsets.reserve(rc);
+		for (int i = 0; i < rc; ++i) {
+			if (ovector[2 * i] == PCRE2_UNSET)
+				result.offsets.emplace_back(PCRE2_UNSET, PCRE2_UNSET);
+			else
+				result.offsets.emplace_back(ovector[2 * i] - lo, ovector[2 * i + 1] - lo);
+		}
+		result.names = reg->names;
+		result.ready = true;
+		return result;
+	}
+
+	void scan(std::vector<pcre2_smatch> &results, bool last)
+	{
+		PCRE2_SPTR subject = reinterpret_cast<PCRE2_SPTR>(buffer.data());
+		size_t length = buffer.size();
+		// A character split across chunks would fail UTF validation, leave it for the next chunk
+		if (!last && reg->utf && length > 0) {
+#if PCRE2_CODE_UNIT_WIDTH == 8
+			size_t i = length;
+			while (i > 0 && length - i < 3 && (subject[i - 1] & 0xc0) == 0x80) --i;
+			if (i > 0 && subject[i - 1] >= 0xc0) {
+				size_t need = subject[i - 1] >= 0xf0 ? 4 : subject[i - 1] >= 0xe0 ? 3 : 2;
+				if (length - (i - 1) < need)
+					length = i - 1;
+			}
+#elif PCRE2_CODE_UNIT_WIDTH == 16
+			if ((subject[length - 1] & 0xfc00) == 0xd800)
+				--length;
+#endif
+		}
+		pcre2_match_data *match_data = reg->match_data();
+		uint32_t utf_checked = 0;
+		while (scan_from <= length) {
+			// Patterns are only JIT compiled for complete matches, so partial matching goes to the interpreter
+			uint32_t flags = option | utf_checked | (base > 0 ? PCRE2_NOTBOL : 0) | (last ? 0 : PCRE2_PARTIAL_HARD | PCRE2_NO_JIT);
+			int rc = reg->exec(subject, length, scan_from, flags, match_data);
+			if (rc >= 0 || rc == PCRE2_ERROR_NOMATCH || rc == PCRE2_ERROR_PARTIAL)
+				utf_checked = PCRE2_NO_UTF_CHECK;
+			PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(match_data);
+			if (rc == PCRE2_ERROR_PARTIAL) {
+				if (length - reg->retreat(subject, ovector[0], lookbehind) > max_buffer) {
+					// The pending match outgrew the buffer limit, give up on this start position
+					scan_from = reg->advance(subject, length, ovector[0]);
+					option = 0;
+					continue;
+				}
+				scan_from = ovector[0];
+				break;
+			}
+			if (rc == PCRE2_ERROR_NOMATCH) {
+				if (option != 0) {
+					// Moving past the end of an empty match needs the next character, which may not have arrived yet,
+					// and a CR at the end may still turn out to be half of a CRLF
+					if (!last && (scan_from >= length || (reg->crlf_newline && scan_from + 1 == length && subject[scan_from] == '\r')))
+						break;
+					option = 0;
+					scan_from = reg->advance(subject, length, scan_from);
+					continue;
+				}
+				// Start again at a trailing CR, PCRE2 does not start matches between CR and LF
+				scan_from = !last && reg->crlf_newline && length > 0 && subject[length - 1] == '\r' ? length - 1 : length;
+				break;
+			}
+			if (rc < 0)
+				throw std::runtime_error("Regex stream match failed");
+			results.emplace_back(make_result(ovector, rc));
+			option = ovector[0] == ovector[1] ? PCRE2_NOTEMPTY_ATSTART | PCRE2_ANCHORED : 0;
+			scan_from = ovector[1];
+		}
+		// Keep the pending match, or the point the next attempt starts from, plus the lookbehind before it
+		size_t keep_from = reg->retreat(subject, std::min(scan_from, length), lookbehind);
+		buffer.erase(0, keep_from);
+		base += keep_from;
+		scan_from -= keep_from;
+	}
+
+public:
+	static constexpr size_t default_max_buffer = 1024 * 1024;
+
+	// Upper bound, in code units, of the tail retained for a pending partial match
+	size_t max_buffer = default_max_buffer;
+
+	explicit pcre2_regex_stream(pcre2_regex_t reg_v) : reg(std::move(reg_v))
+	{
+		uint32_t max_lookbehind = 0;
+		pcre2_pattern_info(reg->code, PCRE2_INFO_MAXLOOKBEHIND, &max_lookbehind);
+		// \b and \B need one character of context even without a lookbehind assertion
+		lookbehind = std::max<size_t>(max_lookbehind, 1);
+	}
+
+	// Stream offset up to which input has been fully decided
+	size_t offset() const
+	{
+		return base + scan_from;
+	}
+
+	std::vector<pcre2_smatch> feed(pcre2_stl_string_view chunk)
+	{
+		if (finished)
+			throw std::logic_error("Regex stream already finished");
+		std::vector<pcre2_smatch> results;
+		buffer.append(chunk);
+		scan(results, false);
+		return results;
+	}
+
+	// Ends the stream, matches held back at the end of the data are resolved without further input
+	std::vector<pcre2_smatch> finish()
+	{
+		std::vector<pcre2_smatch> results;
+		if (!finished) {
+			scan(results, true);
+			finished = true;
+		}
+		return results;
+	}
+};
+#endif
@@ -22,10 +22,22 @@
 #include <covscript/cni.hpp>
 #include <covscript/dll.hpp>
 
+#include <fstream>
+
 #include "pcre2.hpp"
+#include "mapped_file.hpp"
+#include "regex_options.hpp"
+#include "script_subject.hpp"
+#include "stats_map.hpp"
+#include "utf8_index.hpp"
 
 static cs::namespace_t regex_ext = cs::make_shared_namespace<cs::name_space>();
 static cs::namespace_t regex_result_ext = cs::make_shared_namespace<cs::name_space>();
+static cs::namespace_t regex_iterator_ext = cs::make_shared_namespace<cs::name_space>();
+static cs::namespace_t regex_set_ext = cs::make_shared_namespace<cs::name_space>();
+static cs::namespace_t regex_stream_ext = cs::make_shared_namespace<cs::name_space>();
+static cs::namespace_t regex_cache_ext = cs::make_shared_namespace<cs::name_space>();
+static cs::namespace_t regex_index_ext = cs::make_shared_namespace<cs::name_space>();
 
 namespace cs_impl {
 	template <>
@@ -40,6 +52,30 @@ namespace cs_impl {
 		return regex_result_ext;
 	}
 
+	template <>
+	cs::namespace_t &get_ext<pcre2_regex_iterator>()
+	{
+		return regex_iterator_ext;
+	}
+
+	template <>
+	cs::namespace_t &get_ext<pcre2_regex_set_t>()
+	{
+		return regex_set_ext;
+	}
+
+	template <>
+	cs::namespace_t &get_ext<pcre2_regex_stream>()
+	{
+		return regex_stream_ext;
+	}
+
+	template <>
+	cs::namespace_t &get_ext<utf8_index>()
+	{
+		return regex_index_ext;
+	}
+
 	template <>
 	constexpr const char *get_name_of_type<pcre2_regex_t>()
 	{
@@ -51,6 +87,30 @@ namespace cs_impl {
 	{
 		return "cs::regex::result";
 	}
+
+	template <>
+	constexpr const char *get_name_of_type<pcre2_regex_iterator>()
+	{
+		return "cs::regex::iterator";
+	}
+
+	template <>
+	constexpr const char *get_name_of_type<pcre2_regex_set_t>()
+	{
+		return "cs::regex::set";
+	}
+
+	template <>
+	constexpr const char *get_name_of_type<pcre2_regex_stream>()
+	{
+		return "cs::regex::stream";
+	}
+
+	template <>
+	constexpr const char *get_name_of_type<utf8_index>()
+	{
+		return "cs::regex::utf8_index";
+	}
 } // namespace cs_impl
 
 namespace regex_cs_ext {
@@ -58,22 +118,118 @@ namespace regex_cs_ext {
 
 	pcre2_regex_t build(const string &str)
 	{
-		return std::make_shared<pcre2_regex>(str, false);
+		return pcre2_regex_cache::instance().get(str, false);
 	}
 
 	pcre2_regex_t build_optimize(const string &str)
 	{
-		return std::make_shared<pcre2_regex>(str, true);
+		return pcre2_regex_cache::instance().get(str, true);
+	}
+
+	// Routes matching through pcre2_dfa_match, for patterns that would backtrack badly
+	pcre2_regex_t build_dfa(const string &str)
+	{
+		pcre2_regex_config config;
+		config.dfa = true;
+		return pcre2_regex_cache::instance().get(str, config);
+	}
+
+	// Takes the options map described in regex_options.hpp
+	pcre2_regex_t build_ex(const string &str, const hash_map &opts)
+	{
+		pcre2_regex_config config;
+		parse_regex_options(opts, config);
+		return pcre2_regex_cache::instance().get(str, config);
+	}
+
+	// Matched in place and shared with the results that outlive the call, never copied
+	using subject_ref = script_subject<string>;
+
+	string mode(const pcre2_regex_t &reg)
+	{
+		return reg->mode();
+	}
+
+	bool test(pcre2_regex_t &reg, const string &str)
+	{
+		return pcre2_regex_find_pos(*reg, str).first != PCRE2_UNSET;
+	}
+
+	// Start and end of the first match from start, (-1, -1) when there is none
+	pair find_pos(pcre2_regex_t &reg, const string &str, numeric start)
+	{
+		if (start.as_integer() < 0)
+			throw lang_error("Start offset must be non-negative.");
+		auto [begin, end] = pcre2_regex_find_pos(*reg, str, start.as_integer());
+		if (begin == PCRE2_UNSET)
+			return pair(var::make<numeric>(-1), var::make<numeric>(-1));
+		return pair(var::make<numeric>(begin), var::make<numeric>(end));
 	}
 
-	pcre2_smatch match(pcre2_regex_t &reg, const string &str)
+	numeric count(pcre2_regex_t &reg, const string &str)
 	{
-		return pcre2_regex_match(reg, str, PCRE2_ANCHORED | PCRE2_ENDANCHORED);
+		return pcre2_regex_count(*reg, str);
 	}
 
-	pcre2_smatch search(pcre2_regex_t &reg, const string &str)
+	pcre2_smatch match(pcre2_regex_t &reg, const var &str)
 	{
-		return pcre2_regex_match(reg, str, 0);
+		subject_ref subject(str);
+		return subject.bind(pcre2_regex_match(reg, subject.view(), PCRE2_ANCHORED | PCRE2_ENDANCHORED));
+	}
+
+	pcre2_smatch search(pcre2_regex_t &reg, const var &str)
+	{
+		subject_ref subject(str);
+		return subject.bind(pcre2_regex_match(reg, subject.view(), 0));
+	}
+
+	pcre2_smatch search_from(pcre2_regex_t &reg, const var &str, numeric start)
+	{
+		if (start.as_integer() < 0)
+			throw lang_error("Start offset must be non-negative.");
+		subject_ref subject(str);
+		return subject.bind(pcre2_regex_match(reg, subject.view(), 0, start.as_integer()));
+	}
+
+	array find_all(pcre2_regex_t &reg, const var &str)
+	{
+		subject_ref subject(str);
+		array arr;
+		for (auto &m : pcre2_regex_find_all(*reg, subject.view()))
+			arr.push_back(var::make<pcre2_smatch>(subject.bind(std::move(m))));
+		return arr;
+	}
+
+	pcre2_regex_iterator iterate(pcre2_regex_t &reg, const var &str)
+	{
+		return pcre2_regex_iterator(reg, subject_ref(str).share());
+	}
+
+	bool next(pcre2_regex_iterator &it)
+	{
+		return it.next();
+	}
+
+	pcre2_smatch result(const pcre2_regex_iterator &it)
+	{
+		return it.current;
+	}
+
+	array split(pcre2_regex_t &reg, const string &str, numeric limit)
+	{
+		if (limit.as_integer() < 0)
+			throw lang_error("Split limit must be non-negative.");
+		thread_local std::vector<std::pair<size_t, size_t>> pieces;
+		pcre2_regex_split(*reg, str, limit.as_integer(), pieces);
+		array arr(pieces.size());
+		for (size_t i = 0; i < pieces.size(); ++i) {
+			auto [start, end] = pieces[i];
+			if (start == PCRE2_UNSET)
+				arr[i] = var::make<string>();
+			else
+				arr[i] = var::make<string>(str, start, end - start);
+		}
+		return arr;
 	}
 
 	string replace(pcre2_regex_t &reg, const string &str, const string &fmt)
@@ -81,6 +237,27 @@ namespace regex_cs_ext {
 		return pcre2_regex_replace(reg, str, fmt);
 	}
 
+	string replace_with(pcre2_regex_t &reg, const var &str, const var &func)
+	{
+		subject_ref subject(str);
+		return pcre2_regex_replace_with(reg, subject.view(), [&subject] { return subject.share(); }, [&func](const pcre2_smatch &m, string &out) {
+			var rep = invoke(func, var::make<pcre2_smatch>(m));
+			if (rep.type() != typeid(string))
+				throw lang_error("Replacement callback must return a string.");
+			out.append(rep.const_val<string>());
+		});
+	}
+
+	string replace_ex(pcre2_regex_t &reg, const string &str, const string &fmt, numeric flags)
+	{
+		return pcre2_regex_replace(reg, str, fmt, pcre2_replace_option(flags.as_integer()));
+	}
+
+	numeric replace_append(pcre2_regex_t &reg, string &out, const string &str, const string &fmt, numeric flags)
+	{
+		return pcre2_regex_replace_to(reg, str, fmt, out, pcre2_replace_option(flags.as_integer()));
+	}
+
 	bool ready(const pcre2_smatch &m)
 	{
 		return m.ready;
@@ -98,11 +275,13 @@ namespace regex_cs_ext {
 
 	numeric length(const pcre2_smatch &m, numeric index)
 	{
-		return m.str(index.as_integer()).size();
+		return m.length(index.as_integer());
 	}
 
 	numeric position(const pcre2_smatch &m, numeric index)
 	{
+		if (!m.matched(index.as_integer()))
+			return -1;
 		return m.position(index.as_integer());
 	}
 
@@ -113,27 +292,441 @@ namespace regex_cs_ext {
 
 	string prefix(const pcre2_smatch &m)
 	{
-		return m.prefix();
+		return string(m.prefix());
 	}
 
 	string suffix(const pcre2_smatch &m)
 	{
-		return m.suffix();
+		return string(m.suffix());
+	}
+
+	string named(const pcre2_smatch &m, const string &name)
+	{
+		return string(m.named(name));
+	}
+
+	// Every named group of the pattern, unset ones map to an empty string
+	hash_map to_map(const pcre2_smatch &m)
+	{
+		hash_map map;
+		if (m.names) {
+			for (auto &entry : *m.names)
+				map.emplace(var::make<string>(entry.first), var::make<string>(m.named(entry.first)));
+		}
+		return map;
+	}
+
+	// Accepts pattern strings as well as already built regexes
+	pcre2_regex_set_t build_set(const array &patterns)
+	{
+		auto set = std::make_shared<pcre2_regex_set>();
+		for (auto &it : patterns) {
+			if (it.type() == typeid(string))
+				set->add(pcre2_regex_cache::instance().get(it.const_val<string>(), true));
+			else if (it.type() == typeid(pcre2_regex_t))
+				set->add(it.const_val<pcre2_regex_t>());
+			else
+				throw lang_error("Regex set accepts strings or regexes only.");
+		}
+		set->prepare();
+		return set;
+	}
+
+	array set_matches(const pcre2_regex_set_t &set, const string &str)
+	{
+		array arr;
+		for (size_t idx : set->matches(str))
+			arr.push_back(var::make<numeric>(idx));
+		return arr;
+	}
+
+	pair set_first(const pcre2_regex_set_t &set, const var &str)
+	{
+		subject_ref subject(str);
+		auto [idx, m] = set->first(subject.view());
+		return pair(var::make<numeric>(idx), var::make<pcre2_smatch>(subject.bind(std::move(m))));
+	}
+
+	numeric set_size(const pcre2_regex_set_t &set)
+	{
+		return set->size();
+	}
+
+	pcre2_regex_stream stream(pcre2_regex_t &reg)
+	{
+		return pcre2_regex_stream(reg);
+	}
+
+	array stream_feed(pcre2_regex_stream &st, const string &chunk)
+	{
+		array arr;
+		for (auto &m : st.feed(chunk))
+			arr.push_back(var::make<pcre2_smatch>(std::move(m)));
+		return arr;
+	}
+
+	array stream_finish(pcre2_regex_stream &st)
+	{
+		array arr;
+		for (auto &m : st.finish())
+			arr.push_back(var::make<pcre2_smatch>(std::move(m)));
+		return arr;
+	}
+
+	numeric stream_offset(const pcre2_regex_stream &st)
+	{
+		return st.offset();
+	}
+
+	void stream_set_max_buffer(pcre2_regex_stream &st, numeric size)
+	{
+		if (size.as_integer() <= 0)
+			throw lang_error("Stream buffer limit must be positive.");
+		st.max_buffer = size.as_integer();
+	}
+
+	// Built once per string, turns the byte offsets of results into code point offsets without rescanning
+	utf8_index make_utf8_index(const var &str)
+	{
+		return utf8_index(subject_ref(str).share());
+	}
+
+	numeric index_size(const utf8_index &idx)
+	{
+		return idx.size();
+	}
+
+	numeric index_bytes(const utf8_index &idx)
+	{
+		return idx.bytes();
+	}
+
+	numeric byte_to_char(const utf8_index &idx, numeric byte)
+	{
+		if (byte.as_integer() < 0)
+			throw lang_error("Byte offset must be non-negative.");
+		return idx.byte_to_char(byte.as_integer());
+	}
+
+	numeric char_to_byte(const utf8_index &idx, numeric index)
+	{
+		if (index.as_integer() < 0)
+			throw lang_error("Character offset must be non-negative.");
+		return idx.char_to_byte(index.as_integer());
+	}
+
+	string index_substr(const utf8_index &idx, numeric index, numeric count)
+	{
+		if (index.as_integer() < 0 || count.as_integer() < 0)
+			throw lang_error("Character offset and count must be non-negative.");
+		return string(idx.substr(index.as_integer(), count.as_integer()));
+	}
+
+	// The result must come from the indexed string
+	const pcre2_smatch &indexed_match(const utf8_index &idx, const pcre2_smatch &m)
+	{
+		if (m.ready && m.input().size() != idx.bytes())
+			throw lang_error("Regex result does not belong to the indexed string.");
+		return m;
+	}
+
+	numeric char_position(const utf8_index &idx, const pcre2_smatch &m, numeric index)
+	{
+		if (!indexed_match(idx, m).matched(index.as_integer()))
+			return -1;
+		return idx.byte_to_char(m.position(index.as_integer()));
+	}
+
+	numeric char_length(const utf8_index &idx, const pcre2_smatch &m, numeric index)
+	{
+		if (!indexed_match(idx, m).matched(index.as_integer()))
+			return 0;
+		size_t begin = m.position(index.as_integer());
+		return idx.byte_to_char(begin + m.length(index.as_integer())) - idx.byte_to_char(begin);
+	}
+
+	// Views into the script strings, the array must stay untouched while the batch runs
+	std::vector<std::string_view> batch_subjects(const array &strs)
+	{
+		std::vector<std::string_view> subjects;
+		subjects.reserve(strs.size());
+		for (auto &it : strs) {
+			if (it.type() != typeid(string))
+				throw lang_error("Regex batch accepts strings only.");
+			subjects.emplace_back(it.const_val<string>());
+		}
+		return subjects;
+	}
+
+	// Match position of each element, -1 when it does not match
+	array search_batch(pcre2_regex_t &reg, const array &strs, numeric threads)
+	{
+		if (threads.as_integer() < 0)
+			throw lang_error("Thread count must be non-negative.");
+		std::vector<PCRE2_SIZE> positions;
+		pcre2_regex_search_batch(*reg, batch_subjects(strs), 0, threads.as_integer(), positions);
+		array arr(positions.size());
+		for (size_t i = 0; i < positions.size(); ++i)
+			arr[i] = var::make<numeric>(positions[i] == PCRE2_UNSET ? -1 : static_cast<numeric_integer>(positions[i]));
+		return arr;
+	}
+
+	array match_batch(pcre2_regex_t &reg, const array &strs, numeric threads)
+	{
+		if (threads.as_integer() < 0)
+			throw lang_error("Thread count must be non-negative.");
+		std::vector<PCRE2_SIZE> positions;
+		pcre2_regex_search_batch(*reg, batch_subjects(strs), PCRE2_ANCHORED | PCRE2_ENDANCHORED, threads.as_integer(), positions);
+		array arr(positions.size());
+		for (size_t i = 0; i < positions.size(); ++i)
+			arr[i] = var::make<bool>(positions[i] != PCRE2_UNSET);
+		return arr;
+	}
+
+	// overlap 0 splits the subject at line ends, otherwise into windows overlapping by the longest possible match
+	pcre2_regex_parallel make_parallel(pcre2_regex_t &reg, numeric overlap, numeric threads)
+	{
+		if (overlap.as_integer() < 0)
+			throw lang_error("Overlap must be non-negative.");
+		if (threads.as_integer() < 0)
+			throw lang_error("Thread count must be non-negative.");
+		return pcre2_regex_parallel(reg, overlap.as_integer(), threads.as_integer());
+	}
+
+	pcre2_smatch search_parallel(pcre2_regex_t &reg, const var &str, numeric overlap, numeric threads)
+	{
+		subject_ref subject(str);
+		return subject.bind(make_parallel(reg, overlap, threads).search(subject.view()));
+	}
+
+	array find_all_parallel(pcre2_regex_t &reg, const var &str, numeric overlap, numeric threads)
+	{
+		subject_ref subject(str);
+		array arr;
+		for (auto &m : make_parallel(reg, overlap, threads).find_all(subject.view()))
+			arr.push_back(var::make<pcre2_smatch>(subject.bind(std::move(m))));
+		return arr;
+	}
+
+	// Writes a precompiled bundle, strings are built as by build_optimize
+	void save_set(const string &path, const array &regexes)
+	{
+		std::vector<pcre2_regex_t> regs;
+		regs.reserve(regexes.size());
+		for (auto &it : regexes) {
+			if (it.type() == typeid(string))
+				regs.push_back(pcre2_regex_cache::instance().get(it.const_val<string>(), true));
+			else if (it.type() == typeid(pcre2_regex_t))
+				regs.push_back(it.const_val<pcre2_regex_t>());
+			else
+				throw lang_error("Regex bundle accepts strings or regexes only.");
+		}
+		std::string bytes = pcre2_regex_bundle::save(regs);
+		std::ofstream out(path, std::ios::binary | std::ios::trunc);
+		if (!out.write(bytes.data(), bytes.size()))
+			throw lang_error("Failed to write regex bundle: " + path);
+	}
+
+	// Regexes in the order they were saved, also placed in the build cache; JIT code is compiled on first use
+	array load_set(const string &path)
+	{
+		mapped_file file(path);
+		std::vector<pcre2_regex_t> regs;
+		// A damaged bundle is reported to the script, which can rebuild the set from its patterns
+		try {
+			regs = pcre2_regex_bundle::load(file.view());
+		}
+		catch (const std::runtime_error &e) {
+			throw lang_error(e.what());
+		}
+		array arr;
+		for (auto &reg : regs) {
+			pcre2_regex_cache::instance().insert(reg);
+			arr.push_back(var::make<pcre2_regex_t>(std::move(reg)));
+		}
+		return arr;
+	}
+
+	// Matches over a memory-mapped file, returning offset, length and 1-based line number of each match
+	array search_file(pcre2_regex_t &reg, const string &path, numeric max_count)
+	{
+		mapped_file file(path);
+		std::string_view data = file.view();
+		size_t limit = max_count.as_integer() > 0 ? max_count.as_integer() : 0;
+		pcre2_match_data *match_data = reg->match_data();
+		pcre2_regex_scanner scanner(*reg, data);
+		size_t line = 1, counted = 0;
+		array arr;
+		while ((limit == 0 || arr.size() < limit) && scanner.next(match_data) > 0) {
+			PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(match_data);
+			line += std::count(data.begin() + counted, data.begin() + ovector[0], '\n');
+			counted = ovector[0];
+			hash_map m;
+			m.emplace(var::make<string>("offset"), var::make<numeric>(ovector[0]));
+			m.emplace(var::make<string>("length"), var::make<numeric>(ovector[1] - ovector[0]));
+			m.emplace(var::make<string>("line"), var::make<numeric>(line));
+			arr.push_back(var::make<hash_map>(std::move(m)));
+		}
+		if (scanner.error != 0)
+			throw lang_error("Regex search failed in " + path + " at offset " + std::to_string(pcre2_get_startchar(match_data)));
+		return arr;
+	}
+
+	// Lines of a memory-mapped file that contain a match, without their line terminators
+	array grep_file(pcre2_regex_t &reg, const string &path, numeric max_count)
+	{
+		mapped_file file(path);
+		std::string_view data = file.view();
+		size_t limit = max_count.as_integer() > 0 ? max_count.as_integer() : 0;
+		pcre2_match_data *match_data = reg->match_data();
+		pcre2_regex_scanner scanner(*reg, data);
+		array arr;
+		while ((limit == 0 || arr.size() < limit) && scanner.next(match_data) > 0) {
+			PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(match_data);
+			size_t begin = data.rfind('\n', ovector[0] == 0 ? 0 : ovector[0] - 1);
+			begin = (begin == std::string_view::npos || ovector[0] == 0) ? 0 : begin + 1;
+			size_t end = data.find('\n', std::max(ovector[0], ovector[1] == 0 ? 0 : ovector[1] - 1));
+			if (end == std::string_view::npos)
+				end = data.size();
+			size_t text_end = end > begin && data[end - 1] == '\r' ? end - 1 : end;
+			arr.push_back(var::make<string>(data.substr(begin, text_end - begin)));
+			// One entry per line, resume at the start of the next line
+			scanner.offset = end + 1;
+			scanner.option = 0;
+		}
+		if (scanner.error != 0)
+			throw lang_error("Regex search failed in " + path + " at offset " + std::to_string(pcre2_get_startchar(match_data)));
+		return arr;
+	}
+
+	hash_map cache_stats()
+	{
+		auto s = pcre2_regex_cache::instance().stats();
+		hash_map map;
+		map.emplace(var::make<string>("hits"), var::make<numeric>(s.hits));
+		map.emplace(var::make<string>("misses"), var::make<numeric>(s.misses));
+		map.emplace(var::make<string>("evictions"), var::make<numeric>(s.evictions));
+		map.emplace(var::make<string>("size"), var::make<numeric>(s.size));
+		map.emplace(var::make<string>("capacity"), var::make<numeric>(s.capacity));
+		return map;
+	}
+
+	// Counting is off by default, it costs a clock read per match while on
+	void enable_stats(bool on)
+	{
+		match_stats::enable(on);
+	}
+
+	void reset_stats()
+	{
+		pcre2_regex_reset_stats();
+	}
+
+	hash_map regex_stats(const pcre2_regex_t &reg)
+	{
+		return make_stats_map(reg->pattern, reg->mode(), reg->stats.read());
+	}
+
+	// Every live regex that has been called, most time spent first
+	array all_stats()
+	{
+		array arr;
+		for (auto &entry : pcre2_regex_top_stats())
+			arr.push_back(var::make<hash_map>(make_stats_map(entry.pattern, entry.mode, entry.stats)));
+		return arr;
+	}
+
+	array top_stats(numeric n)
+	{
+		if (n.as_integer() <= 0)
+			return array();
+		array arr;
+		for (auto &entry : pcre2_regex_top_stats(n.as_integer()))
+			arr.push_back(var::make<hash_map>(make_stats_map(entry.pattern, entry.mode, entry.stats)));
+		return arr;
+	}
+
+	void cache_set_capacity(numeric capacity)
+	{
+		if (capacity.as_integer() < 0)
+			throw lang_error("Cache capacity must be non-negative.");
+		pcre2_regex_cache::instance().set_capacity(capacity.as_integer());
+	}
+
+	void cache_clear()
+	{
+		pcre2_regex_cache::instance().clear();
 	}
 
 	void init(name_space *ns)
 	{
 		(*ns)
 		.add_var("result", make_namespace(regex_result_ext))
+		.add_var("iterator", make_namespace(regex_iterator_ext))
+		.add_var("set", make_namespace(regex_set_ext))
+		.add_var("stream", make_namespace(regex_stream_ext))
+		.add_var("make_stream", make_cni(stream))
+		.add_var("utf8_index", make_namespace(regex_index_ext))
+		.add_var("make_utf8_index", make_cni(make_utf8_index))
+		.add_var("cache", make_namespace(regex_cache_ext))
+		.add_var("enable_stats", make_cni(enable_stats))
+		.add_var("reset_stats", make_cni(reset_stats))
+		.add_var("stats", make_cni(all_stats))
+		.add_var("top", make_cni(top_stats))
+		.add_var("build_set", make_cni(build_set))
+		.add_var("search_file", make_cni(search_file))
+		.add_var("grep_file", make_cni(grep_file))
+		.add_var("search_batch", make_cni(search_batch))
+		.add_var("match_batch", make_cni(match_batch))
+		.add_var("search_parallel", make_cni(search_parallel))
+		.add_var("find_all_parallel", make_cni(find_all_parallel))
+		.add_var("save_set", make_cni(save_set))
+		.add_var("load_set", make_cni(load_set))
 		.add_var("build", make_cni(build))
 		.add_var("build_optimize", make_cni(build_optimize))
+		.add_var("build_ex", make_cni(build_ex))
+		.add_var("build_dfa", make_cni(build_dfa))
 		.add_var("match", make_cni(match))
 		.add_var("search", make_cni(search))
-		.add_var("replace", make_cni(replace));
+		.add_var("search_from", make_cni(search_from))
+		.add_var("test", make_cni(test))
+		.add_var("find_pos", make_cni(find_pos))
+		.add_var("count", make_cni(count))
+		.add_var("find_all", make_cni(find_all))
+		.add_var("iterate", make_cni(iterate))
+		.add_var("split", make_cni(split))
+		.add_var("replace", make_cni(replace))
+		.add_var("replace_with", make_cni(replace_with))
+		.add_var("replace_ex", make_cni(replace_ex))
+		.add_var("replace_append", make_cni(replace_append))
+		.add_var("replace_first", var::make_constant<numeric>(1))
+		.add_var("replace_literal", var::make_constant<numeric>(2));
 		(*regex_ext)
+		.add_var("mode", make_cni(mode))
+		.add_var("stats", make_cni(regex_stats))
 		.add_var("match", make_cni(match))
 		.add_var("search", make_cni(search))
-		.add_var("replace", make_cni(replace));
+		.add_var("search_from", make_cni(search_from))
+		.add_var("test", make_cni(test))
+		.add_var("find_pos", make_cni(find_pos))
+		.add_var("count", make_cni(count))
+		.add_var("find_all", make_cni(find_all))
+		.add_var("iterate", make_cni(iterate))
+		.add_var("split", make_cni(split))
+		.add_var("replace", make_cni(replace))
+		.add_var("replace_with", make_cni(replace_with))
+		.add_var("replace_ex", make_cni(replace_ex))
+		.add_var("replace_append", make_cni(replace_append))
+		.add_var("stream", make_cni(stream))
+		.add_var("search_file", make_cni(search_file))
+		.add_var("grep_file", make_cni(grep_file))
+		.add_var("search_batch", make_cni(search_batch))
+		.add_var("match_batch", make_cni(match_batch))
+		.add_var("search_parallel", make_cni(search_parallel))
+		.add_var("find_all_parallel", make_cni(find_all_parallel));
+		(*regex_iterator_ext)
+		.add_var("next", make_cni(next))
+		.add_var("result", make_cni(result));
 		(*regex_result_ext)
 		.add_var("ready", make_cni(ready))
 		.add_var("empty", make_cni(empty))
@@ -142,7 +735,30 @@ namespace regex_cs_ext {
 		.add_var("position", make_cni(position))
 		.add_var("str", make_cni(str))
 		.add_var("prefix", make_cni(prefix))
-		.add_var("suffix", make_cni(suffix));
+		.add_var("suffix", make_cni(suffix))
+		.add_var("named", make_cni(named))
+		.add_var("to_map", make_cni(to_map));
+		(*regex_set_ext)
+		.add_var("matches", make_cni(set_matches))
+		.add_var("first", make_cni(set_first))
+		.add_var("size", make_cni(set_size));
+		(*regex_stream_ext)
+		.add_var("feed", make_cni(stream_feed))
+		.add_var("finish", make_cni(stream_finish))
+		.add_var("offset", make_cni(stream_offset))
+		.add_var("set_max_buffer", make_cni(stream_set_max_buffer));
+		(*regex_cache_ext)
+		.add_var("stats", make_cni(cache_stats))
+		.add_var("set_capacity", make_cni(cache_set_capacity))
+		.add_var("clear", make_cni(cache_clear));
+		(*regex_index_ext)
+		.add_var("size", make_cni(index_size))
+		.add_var("bytes", make_cni(index_bytes))
+		.add_var("byte_to_char", make_cni(byte_to_char))
+		.add_var("char_to_byte", make_cni(char_to_byte))
+		.add_var("substr", make_cni(index_substr))
+		.add_var("char_position", make_cni(char_position))
+		.add_var("char_length", make_cni(char_length));
 	}
 } // namespace regex_cs_ext
 
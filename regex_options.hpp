@@ -0,0 +1,38 @@
+#pragma once
+#include <covscript/cni.hpp>
+#include <cstdint>
+
+// Options map of regex.build_ex and its unicode counterparts, for the pcre2_regex_config of any code unit
+// width: boolean switches (caseless, multiline, dotall, extended, ungreedy, literal, no_auto_capture, anchored,
+// dollar_endonly, dupnames, ucp, utf, jit, dfa, no_utf_check), numeric match_limit, depth_limit and
+// heap_limit, and newline as one of "cr", "lf", "crlf", "any", "anycrlf" or "nul"
+template <typename config_type>
+void parse_regex_options(const cs::hash_map &opts, config_type &config)
+{
+	using namespace cs;
+	for (auto &entry : opts) {
+		const var &key = entry.first, &value = entry.second;
+		if (key.type() != typeid(string))
+			throw lang_error("Regex option names must be strings.");
+		const string &name = key.const_val<string>();
+		bool known;
+		if (value.type() == typeid(bool))
+			known = config.set_flag(name, value.const_val<bool>());
+		else if (value.type() == typeid(numeric)) {
+			// The limits are uint32_t in PCRE2, larger values would wrap around
+			const auto limit = value.const_val<numeric>().as_integer();
+			if (limit < 0 || limit > UINT32_MAX)
+				throw lang_error("Regex limit must be between 0 and 4294967295: " + name);
+			known = config.set_limit(name, static_cast<uint32_t>(limit));
+		}
+		else if (value.type() == typeid(string) && name == "newline") {
+			if (!config.set_newline(value.const_val<string>()))
+				throw lang_error("Unknown newline convention: " + value.const_val<string>());
+			known = true;
+		}
+		else
+			known = false;
+		if (!known)
+			throw lang_error("Unknown regex option or wrong value type: " + name);
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <covscript/cni.hpp>
+#include <type_traits>
+#include <memory>
+
+#include "shared_subject.hpp"
+
+// Script string that one call of the regex and unicode modules matches in place. Results that outlive the
+// call get a shared_subject holding the script value instead of a copy of the text, made once per call and
+// only when the first such result appears, so a miss allocates nothing.
+template <typename string_type>
+class script_subject {
+	const cs::var &value;
+	shared_subject<string_type> shared;
+
+public:
+	explicit script_subject(const cs::var &value_v) : value(value_v)
+	{
+		if (value.type() != typeid(string_type))
+			throw cs::lang_error(std::is_same<string_type, cs::string>::value ? "Regex subject must be a string." : "Regex subject must be a wstring.");
+	}
+
+	typename shared_subject<string_type>::view_type view() const
+	{
+		return value.const_val<string_type>();
+	}
+
+	const shared_subject<string_type> &share()
+	{
+		if (!shared) {
+			auto holder = std::make_shared<cs::var>(value);
+			shared = std::shared_ptr<const string_type>(holder, &holder->const_val<string_type>());
+		}
+		return shared;
+	}
+
+	// Gives a result that matched the string to read its groups from
+	template <typename match_type>
+	match_type bind(match_type m)
+	{
+		if (m.ready)
+			m.subject = share();
+		return m;
+	}
+};
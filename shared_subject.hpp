@@ -0,0 +1,57 @@
+#pragma once
+#include <string_view>
+#include <stdexcept>
+#include <memory>
+
+// Handle to a string shared with the results, iterators and indexes that outlive the call that made them.
+// The owner keeps the string alive without copying it, which for script strings is the script value itself,
+// so the string may still change afterwards: its data pointer and size are recorded when the handle is made
+// and every access checks them.
+template <typename string_type>
+class shared_subject {
+public:
+	using char_type = typename string_type::value_type;
+	using view_type = std::basic_string_view<char_type>;
+
+private:
+	std::shared_ptr<const string_type> text;
+	const char_type *data = nullptr;
+	size_t length = 0;
+
+public:
+	shared_subject() = default;
+
+	// text may alias whatever owns the string
+	shared_subject(std::shared_ptr<const string_type> text_v) : text(std::move(text_v))
+	{
+		if (text) {
+			data = text->data();
+			length = text->size();
+		}
+	}
+
+	explicit operator bool() const
+	{
+		return text != nullptr;
+	}
+
+	// Size when the handle was made
+	size_t size() const
+	{
+		return length;
+	}
+
+	// Same-length edits in place are not detected, they cannot make a read go out of bounds
+	void check() const
+	{
+		if (text && (text->data() != data || text->size() != length))
+			throw std::runtime_error("String was modified after it was matched or indexed");
+	}
+
+	// Empty for an empty handle
+	view_type view() const
+	{
+		check();
+		return view_type(data, length);
+	}
+};
@@ -0,0 +1,25 @@
+#pragma once
+#include <covscript/cni.hpp>
+
+#include "match_stats.hpp"
+
+// Script view of one regex's statistics, for the regex and unicode modules; the pattern keeps its own
+// string type so that wregex patterns stay wstrings
+template <typename string_type>
+cs::hash_map make_stats_map(const string_type &pattern, const char *mode, const match_stats::snapshot &s)
+{
+	using namespace cs;
+	hash_map map;
+	map.emplace(var::make<string>("pattern"), var::make<string_type>(pattern));
+	map.emplace(var::make<string>("mode"), var::make<string>(mode));
+	map.emplace(var::make<string>("calls"), var::make<numeric>(s.calls));
+	map.emplace(var::make<string>("matches"), var::make<numeric>(s.matches));
+	map.emplace(var::make<string>("bytes"), var::make<numeric>(s.bytes));
+	map.emplace(var::make<string>("time"), var::make<numeric>(s.nanoseconds / 1e9));
+	map.emplace(var::make<string>("prefiltered"), var::make<numeric>(s.engine_calls[match_stats::prefilter]));
+	map.emplace(var::make<string>("interpreter"), var::make<numeric>(s.engine_calls[match_stats::interpreter]));
+	map.emplace(var::make<string>("jit"), var::make<numeric>(s.engine_calls[match_stats::jit]));
+	map.emplace(var::make<string>("dfa"), var::make<numeric>(s.engine_calls[match_stats::dfa]));
+	map.emplace(var::make<string>("limit_hits"), var::make<numeric>(s.limit_hits));
+	return map;
+}
@@ -6,3 +6,5 @@ system.out.println(cvt.wide2local(str))
 for i = 0, i < str.size, ++i
     system.out.println(cvt.wide2local(str.at(i).to_wstring()) + " " + cvt.is_identifier(str.at(i)))
 end
+var strict = unicode.codecvt.strict
+system.out.println(unicode.codecvt.gb18030_encode(unicode.codecvt.gb18030_decode("", strict), strict) + " " + (str.at(0) == unicode.codecvt.gbk_decode("", strict).at(0)))
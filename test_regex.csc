@@ -6,3 +6,105 @@ system.out.println("Matched groups: " + sm.size())
 foreach i in range(sm.size())
     system.out.println(sm.str(i))
 end
+
+var digits = regex.build("\\d+")
+foreach m in digits.find_all("a1b22c333")
+    system.out.println(m.str(0) + " at " + m.position(0))
+end
+
+var fields = regex.build("\\s*,\\s*").split("a, b ,c,,d", 0)
+system.out.println("Fields: " + fields.size)
+
+var mails = {"a@b.com", "nobody", "c@d.org"}
+system.out.println("Batch: " + regex.build_optimize("\\w+@\\w+\\.\\w+").search_batch(mails, 0).size)
+
+var loose = regex.build_ex("hello", {"caseless": true, "match_limit": 100000}.to_hash_map())
+system.out.println("Caseless: " + loose.search("Say HELLO").ready())
+system.out.println("Count: " + digits.count("a1b22c333") + ", has digits: " + digits.test("abc"))
+
+var addr = regex.build("(?<user>\\w+)@(?<host>[\\w.]+)").search("mail bob@example.com")
+system.out.println("User " + addr.named("user") + " at " + addr.to_map()["host"])
+
+regex.enable_stats(true)
+digits.count("a1b22c333")
+foreach s in regex.top(1)
+    system.out.println("Slowest: " + s["pattern"] + ", calls " + s["calls"] + ", matches " + s["matches"])
+end
+regex.enable_stats(false)
+
+var text = "价格: 42 元, 数量: 7"
+var idx = regex.make_utf8_index(text)
+foreach m in regex.build("\\d+").find_all(text)
+    system.out.println(m.str(0) + " at byte " + m.position(0) + ", char " + idx.char_position(m, 0))
+end
+
+var routes = regex.build_set({"GET /api/v1/users/(\\d+)", "POST /api/v1/users", "GET /api/v2/.*"})
+foreach idx in routes.matches("GET /api/v1/users/42")
+    system.out.println("Route " + idx + " matches")
+end
+
+var lines = ""
+for i = 0, i < 20000, ++i
+    lines += "foo\n"
+end
+system.out.println("foo\\Z in parallel: " + regex.build("foo\\Z").find_all_parallel(lines, 0, 4).size + " (sequential: " + regex.build("foo\\Z").count(lines) + ")")
+
+var st = regex.build("\\d+ms").stream()
+var early = st.feed("took 12")
+var found = st.feed("3ms, then 4")
+system.out.println("Stream: " + early.size + " early, " + found[0].str(0) + " at " + found[0].position(0) + ", " + st.finish().size + " at finish, offset " + st.offset())
+
+var greeting = "你好，世界"
+var us = regex.make_stream(regex.build("世界"))
+us.set_max_buffer(64)
+var held = us.feed(greeting.substr(0, 13))
+var whole = us.feed(greeting.substr(13, 2))
+system.out.println("Split character: " + held.size + " held, " + whole[0].str(0) + " at byte " + whole[0].position(0))
+
+var log_path = "regex_test_grep.log"
+var log_out = iostream.fstream(log_path, iostream.openmode.out)
+log_out.print("INFO start\r\nERROR disk full\r\nINFO retry\nERROR gave up\n")
+log_out.flush()
+var errors = regex.build("ERROR")
+foreach line in errors.grep_file(log_path, 0)
+    system.out.println("Grep: [" + line + "]")
+end
+foreach hit in errors.search_file(log_path, 1)
+    system.out.println("First error at offset " + hit["offset"] + ", line " + hit["line"] + ", length " + hit["length"])
+end
+var empty_path = "regex_test_empty.log"
+var empty_out = iostream.fstream(empty_path, iostream.openmode.out)
+empty_out.flush()
+system.out.println("Empty file: " + errors.grep_file(empty_path, 0).size + " lines, " + regex.build("x*").search_file(empty_path, 0).size + " matches")
+system.file.remove(log_path)
+system.file.remove(empty_path)
+
+var bundle_path = "regex_test.bundle"
+regex.save_set(bundle_path, {"\\d+", regex.build_ex("[a-z]+", {"caseless": true}.to_hash_map())})
+var loaded = regex.load_set(bundle_path)
+system.out.println("Bundle: " + loaded.size + " regexes, " + loaded[0].count("a1b22") + " numbers, " + loaded[1].search("123 ABC").str(0))
+var bundle_out = iostream.fstream(bundle_path, iostream.openmode.app)
+bundle_out.print("x")
+bundle_out.flush()
+try
+    regex.load_set(bundle_path)
+    system.out.println("Damaged bundle loaded")
+catch e
+    system.out.println("Damaged bundle: " + e.what)
+end
+var stub_out = iostream.fstream(bundle_path, iostream.openmode.out)
+stub_out.print("CSRX")
+stub_out.flush()
+try
+    regex.load_set(bundle_path)
+    system.out.println("Truncated bundle loaded")
+catch e
+    system.out.println("Truncated bundle: " + e.what)
+end
+system.file.remove(bundle_path)
+
+function bracket(m)
+    return "<" + m.str(0) + ">"
+end
+var stars = regex.build("x*")
+system.out.println("Replace with: " + stars.replace_with("abc", bracket) + " " + stars.replace_with("axxb", bracket))
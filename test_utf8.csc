@@ -6,3 +6,21 @@ system.out.println(cvt.wide2local(str))
 for i = 0, i < str.size, ++i
     system.out.println(cvt.wide2local(str.at(i).to_wstring()) + " " + cvt.is_identifier(str.at(i)))
 end
+var decoded = unicode.codecvt.utf8_decode("你好，世界！", unicode.codecvt.strict)
+system.out.println(unicode.codecvt.utf8_encode(decoded, unicode.codecvt.strict) + " valid: " + (unicode.codecvt.utf8_validate("你好") == -1))
+var m = unicode.build_u8regex("\\p{Han}+").search("Hello, 世界！")
+system.out.println(m.str(0) + " bytes: " + m.position(0) + " chars: " + m.char_position(0) + "+" + m.char_length(0))
+var idx = unicode.build_utf8_index("Hello, 世界！")
+system.out.println(idx.substr(7, 2) + " " + idx.char_to_byte(9) + " " + cvt.wide2local(idx.wsubstr(7, 3)))
+var mixed = cvt.local2wide("Größe 大小 ２０")
+var masks = mixed.classify()
+system.out.println(cvt.wide2local(mixed.toupper()) + " alpha: " + mixed.count_class(unicode.wchar.alpha) + " decimal: " + mixed.count_class(unicode.wchar.decimal))
+system.out.println("大 class mask: " + masks[6] + ", alpha: " + unicode.wchar.isalpha(mixed.at(6)))
+function wbracket(m)
+    var out = cvt.local2wide("<")
+    out.append(m.str(0))
+    out.append(cvt.local2wide(">"))
+    return out
+end
+var wstars = unicode.build_wregex(cvt.local2wide("世*"))
+system.out.println("Wide replace with: " + cvt.wide2local(wstars.replace_with(cvt.local2wide("你世世界"), wbracket)) + " " + cvt.wide2local(wstars.replace_with(cvt.local2wide("ab"), wbracket)))
@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+# Generates gbk_tables.hpp from Python's gb18030 codec (GB18030-2005 mappings).
+# Usage: python3 tools/gen_gbk_tables.py > gbk_tables.hpp
+
+TRAILS = list(range(0x40, 0x7F)) + list(range(0x80, 0xFF))
+
+
+def four_byte_linear(b):
+    return ((b[0] - 0x81) * 10 + (b[1] - 0x30)) * 1260 + (b[2] - 0x81) * 10 + (b[3] - 0x30)
+
+
+def two_byte_table():
+    table = []
+    for lead in range(0x81, 0xFF):
+        for trail in range(0x40, 0xFF):
+            if trail == 0x7F:
+                table.append(0)
+                continue
+            cp = ord(bytes([lead, trail]).decode('gb18030'))
+            assert 0 < cp < 0x10000
+            table.append(cp)
+    return table
+
+
+def four_byte_ranges():
+    ranges = []
+    prev = None
+    for cp in range(0x80, 0x10000):
+        if 0xD800 <= cp <= 0xDFFF:
+            continue
+        code = chr(cp).encode('gb18030')
+        if len(code) != 4:
+            continue
+        linear = four_byte_linear(code)
+        if prev is None or linear != prev[0] + 1 or cp != prev[1] + 1:
+            ranges.append((linear, cp))
+        prev = (linear, cp)
+    # The linear indices must be dense so that each run ends where the next begins
+    assert prev[0] == 39419 and prev[1] == 0xFFFF
+    return ranges
+
+
+def emit(values, per_line, width):
+    lines = []
+    for i in range(0, len(values), per_line):
+        lines.append('\t\t' + ', '.join('0x%0*X' % (width, v) for v in values[i:i + per_line]) + ',')
+    return '\n'.join(lines)
+
+
+def main():
+    two = two_byte_table()
+    ranges = four_byte_ranges()
+    print('// Generated by tools/gen_gbk_tables.py from the GB18030-2005 mapping, do not edit.')
+    print('#pragma once')
+    print('#include <cstdint>')
+    print()
+    print('namespace gbk_codec {')
+    print('\t// Code points of the two-byte codes, lead 0x81-0xFE by trail 0x40-0xFE; 0 for the invalid trail 0x7F')
+    print('\tinline constexpr uint16_t two_byte_table[126 * 191] = {')
+    print(emit(two, 16, 4))
+    print('\t};')
+    print()
+    print('\t// Four-byte codes of the BMP as runs of consecutive code points: {linear index, first code point}.')
+    print('\t// Linear indices are dense, each run ends where the next one begins and the last ends at U+FFFF.')
+    print('\tinline constexpr uint16_t four_byte_ranges[%d][2] = {' % len(ranges))
+    for i in range(0, len(ranges), 6):
+        print('\t\t' + ' '.join('{0x%04X, 0x%04X},' % r for r in ranges[i:i + 6]))
+    print('\t};')
+    print('} // namespace gbk_codec')
+
+
+if __name__ == '__main__':
+    main()
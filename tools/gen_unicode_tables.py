@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+# Generates unicode_tables.hpp from the Unicode Character Database bundled with Python (unicodedata).
+# Usage: python3 tools/gen_unicode_tables.py > unicode_tables.hpp
+
+import unicodedata
+
+SHIFT = 7
+BLOCK = 1 << SHIFT
+MAX_CODE_POINT = 0x10FFFF
+
+# Bit order of the flags, shared with unicode_class.hpp through the generated enum
+FLAGS = ['alpha', 'digit', 'decimal', 'alnum', 'upper', 'lower', 'space', 'blank', 'cntrl', 'punct', 'graph',
+         'print', 'id_start', 'id_continue']
+BIT = {name: 1 << i for i, name in enumerate(FLAGS)}
+
+
+def flags(c):
+    cat = unicodedata.category(c)
+    f = 0
+    if c.isalpha():
+        f |= BIT['alpha']
+    # As in C, digit is only 0-9; decimal is every decimal digit (Nd)
+    if '0' <= c <= '9':
+        f |= BIT['digit']
+    if c.isdecimal():
+        f |= BIT['decimal']
+    if c.isalpha() or c.isdecimal():
+        f |= BIT['alnum']
+    if c.isupper():
+        f |= BIT['upper']
+    if c.islower():
+        f |= BIT['lower']
+    if c.isspace():
+        f |= BIT['space']
+    if c == '\t' or cat == 'Zs':
+        f |= BIT['blank']
+    if cat in ('Cc', 'Zl', 'Zp'):
+        f |= BIT['cntrl']
+    if cat[0] in 'PS':
+        f |= BIT['punct']
+    graph = cat[0] != 'Z' and cat not in ('Cc', 'Cf', 'Cs', 'Cn')
+    if graph:
+        f |= BIT['graph']
+    if graph or cat == 'Zs':
+        f |= BIT['print']
+    # XID_Start plus the underscore, and XID_Continue
+    if c.isidentifier():
+        f |= BIT['id_start']
+    if ('a' + c).isidentifier():
+        f |= BIT['id_continue']
+    return f
+
+
+# Python applies the full case mappings; the simple ones differ only where the full mapping has several code points
+def simple_lower(c):
+    lower = c.lower()
+    if len(lower) == 1:
+        return ord(lower)
+    # U+0130 is the only code point lowercasing to several, its simple mapping is the first of them
+    assert c == 'İ', hex(ord(c))
+    return ord(lower[0])
+
+
+def simple_upper(c):
+    upper = c.upper()
+    if len(upper) == 1:
+        return ord(upper)
+    # Where the full mapping expands, the simple one is the titlecase form if that is a single other code point
+    title = c.title()
+    return ord(title) if len(title) == 1 and title != c else ord(c)
+
+
+def record(cp):
+    if 0xD800 <= cp <= 0xDFFF:
+        return (0, 0, 0)
+    c = chr(cp)
+    return (flags(c), simple_lower(c) - cp, simple_upper(c) - cp)
+
+
+def build():
+    records = {(0, 0, 0): 0}
+    blocks = {}
+    block_index = []
+    block_data = []
+    for start in range(0, MAX_CODE_POINT + 1, BLOCK):
+        block = tuple(records.setdefault(record(cp), len(records)) for cp in range(start, start + BLOCK))
+        if block not in blocks:
+            blocks[block] = len(blocks)
+            block_data.extend(block)
+        block_index.append(blocks[block])
+    ordered = sorted(records, key=records.get)
+    return ordered, block_index, block_data
+
+
+def index_type(values):
+    return 'uint8_t' if max(values) < 0x100 else 'uint16_t'
+
+
+def emit(values, per_line):
+    lines = []
+    for i in range(0, len(values), per_line):
+        lines.append('\t\t' + ', '.join(str(v) for v in values[i:i + per_line]) + ',')
+    return '\n'.join(lines)
+
+
+def main():
+    records, block_index, block_data = build()
+    print('// Generated by tools/gen_unicode_tables.py from Unicode %s, do not edit.' % unicodedata.unidata_version)
+    print('#pragma once')
+    print('#include <cstdint>')
+    print()
+    print('namespace unicode_class {')
+    print('\tinline constexpr const char *unicode_version = "%s";' % unicodedata.unidata_version)
+    print()
+    print('\tenum flag : uint16_t {')
+    for name in FLAGS:
+        print('\t\t%s = 0x%04X,' % (name, BIT[name]))
+    print('\t};')
+    print()
+    print('\t// Properties shared by many code points: flags, and simple lowercase and uppercase mappings as deltas')
+    print('\tstruct record {')
+    print('\t\tuint16_t flags;')
+    print('\t\tint32_t lower;')
+    print('\t\tint32_t upper;')
+    print('\t};')
+    print()
+    print('\tinline constexpr unsigned block_shift = %d;' % SHIFT)
+    print()
+    print('\tinline constexpr record records[%d] = {' % len(records))
+    for i in range(0, len(records), 4):
+        print('\t\t' + ' '.join('{0x%04X, %d, %d},' % r for r in records[i:i + 4]))
+    print('\t};')
+    print()
+    print('\t// Block of each run of %d code points' % BLOCK)
+    print('\tinline constexpr %s block_index[%d] = {' % (index_type(block_index), len(block_index)))
+    print(emit(block_index, 32))
+    print('\t};')
+    print()
+    print('\t// Record of each code point, block by block')
+    print('\tinline constexpr %s block_data[%d] = {' % (index_type(block_data), len(block_data)))
+    print(emit(block_data, 32))
+    print('\t};')
+    print('} // namespace unicode_class')
+
+
+if __name__ == '__main__':
+    main()
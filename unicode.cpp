@@ -21,149 +21,19 @@
  */
 #include <covscript/cni.hpp>
 #include <covscript/dll.hpp>
-#include <codecvt>
-#include <cwctype>
+#include <fstream>
 
-using uwchar_t = char32_t;
-using uwstring_t = std::u32string;
+#include "codecvt.hpp"
 
 #define PCRE2_CODE_UNIT_WIDTH 32
 #define pcre2_stl_string std::u32string
 #define pcre2_stl_string_view std::u32string_view
 
 #include "pcre2.hpp"
-
-namespace codecvt_impl {
-#if COVSCRIPT_ABI_VERSION < 251108
-	using namespace cs;
-
-	class charset {
-	public:
-		virtual ~charset() = default;
-
-		virtual uwstring_t local2wide(const std::string &) = 0;
-
-		virtual std::string wide2local(const uwstring_t &) = 0;
-
-		virtual bool is_identifier(uwchar_t) = 0;
-	};
-
-	class ascii final : public charset {
-	public:
-		uwstring_t local2wide(const std::string &local) override
-		{
-			return uwstring_t(local.begin(), local.end());
-		}
-
-		std::string wide2local(const uwstring_t &str) override
-		{
-			std::string local;
-			local.reserve(str.size());
-			for (auto ch : str) local.push_back(ch);
-			return std::move(local);
-		}
-
-		bool is_identifier(uwchar_t ch) override
-		{
-			return ch == '_' || std::iswalnum(ch);
-		}
-	};
-
-	class utf8 final : public charset {
-		std::wstring_convert<std::codecvt_utf8<uwchar_t>, uwchar_t> cvt;
-
-		static constexpr std::uint32_t ascii_max = 0x7F;
-
-	public:
-		uwstring_t local2wide(const std::string &str) override
-		{
-			return cvt.from_bytes(str);
-		}
-
-		std::string wide2local(const uwstring_t &str) override
-		{
-			return cvt.to_bytes(str);
-		}
-
-		bool is_identifier(uwchar_t ch) override
-		{
-			/**
-			 * Chinese Character in Unicode Charset
-			 * Basic:    0x4E00 - 0x9FA5
-			 * Extended: 0x9FA6 - 0x9FEF
-			 * Special:  0x3007
-			 */
-			if (ch > ascii_max)
-				return (ch >= 0x4E00 && ch <= 0x9FA5) || (ch >= 0x9FA6 && ch <= 0x9FEF) ||
-				       ch == 0x3007;
-			else
-				return ch == '_' || std::iswalnum(ch);
-		}
-	};
-
-	class gbk final : public charset {
-		static inline uwchar_t set_zero(uwchar_t ch)
-		{
-			return ch & 0x0000ffff;
-		}
-
-		static constexpr std::uint8_t u8_blck_begin = 0x80;
-		static constexpr std::uint32_t u32_blck_begin = 0x8000;
-
-	public:
-		uwstring_t local2wide(const std::string &local) override
-		{
-			uwstring_t wide;
-			uint32_t head = 0;
-			bool read_next = true;
-			for (auto it = local.begin(); it != local.end();) {
-				if (read_next) {
-					head = *(it++);
-					if (head & u8_blck_begin)
-						read_next = false;
-					else
-						wide.push_back(set_zero(head));
-				}
-				else {
-					std::uint8_t tail = *(it++);
-					wide.push_back(set_zero(head << 8 | tail));
-					read_next = true;
-				}
-			}
-			if (!read_next) throw compile_error("Codecvt: Bad encoding.");
-			return std::move(wide);
-		}
-
-		std::string wide2local(const uwstring_t &wide) override
-		{
-			std::string local;
-			for (auto &ch : wide) {
-				if (ch & u32_blck_begin) local.push_back(ch >> 8);
-				local.push_back(ch);
-			}
-			return std::move(local);
-		}
-
-		bool is_identifier(uwchar_t ch) override
-		{
-			/**
-			 * Chinese Character in GBK Charset
-			 * GBK/2: 0xB0A1 - 0xF7FE
-			 * GBK/3: 0x8140 - 0xA0FE
-			 * GBK/4: 0xAA40 - 0xFEA0
-			 * GBK/5: 0xA996
-			 */
-			if (ch & u32_blck_begin)
-				return (ch >= 0xB0A1 && ch <= 0xF7FE) || (ch >= 0x8140 && ch <= 0xA0FE) ||
-				       (ch >= 0xAA40 && ch <= 0xFEA0) || ch == 0xA996;
-			else
-				return ch == '_' || std::iswalnum(ch);
-		}
-	};
-#else
-	using namespace cs::codecvt;
-#endif
-} // namespace codecvt_impl
+#include "mapped_file.hpp"
+#include "regex_options.hpp"
+#include "script_subject.hpp"
+#include "stats_map.hpp"
 
 using codecvt_t = std::shared_ptr<codecvt_impl::charset>;
 
@@ -196,6 +66,24 @@ CNI_ROOT_NAMESPACE {
 		             cs::var::make_constant<cs::type_t>(make_codecvt_gbk,
 		                     cs::type_id(typeid(codecvt_t))))
 
+#if COVSCRIPT_ABI_VERSION < 251108
+		cs::var make_codecvt_gb18030() {
+			return codecvt_t(new codecvt_impl::gb18030);
+		}
+
+		CNI_REGISTER(gb18030,
+		             cs::var::make_constant<cs::type_t>(make_codecvt_gb18030,
+		                     cs::type_id(typeid(codecvt_t))))
+
+		cs::var make_codecvt_gbk_legacy() {
+			return codecvt_t(new codecvt_impl::gbk_legacy);
+		}
+
+		CNI_REGISTER(gbk_legacy,
+		             cs::var::make_constant<cs::type_t>(make_codecvt_gbk_legacy,
+		                     cs::type_id(typeid(codecvt_t))))
+#endif
+
 		uwstring_t local2wide(const codecvt_t &cvt, const std::string &str) {
 			return cvt->local2wide(str);
 		}
@@ -213,84 +101,205 @@ CNI_ROOT_NAMESPACE {
 		}
 
 		CNI(is_identifier)
+
+		// Error policies for the utf8_* functions: throw, substitute U+FFFD, or drop the invalid input
+		CNI_REGISTER(strict, var::make_constant<numeric>(0))
+
+		CNI_REGISTER(replace, var::make_constant<numeric>(1))
+
+		CNI_REGISTER(skip, var::make_constant<numeric>(2))
+
+		utf8_transcode::error_policy make_policy(const numeric &policy) {
+			switch (policy.as_integer()) {
+			case 0:
+				return utf8_transcode::error_policy::strict;
+			case 1:
+				return utf8_transcode::error_policy::replace;
+			case 2:
+				return utf8_transcode::error_policy::skip;
+			default:
+				throw lang_error("Unknown codecvt error policy.");
+			}
+		}
+
+		uwstring_t utf8_decode(const std::string &str, const numeric &policy) {
+			return utf8_transcode::decode(str, make_policy(policy));
+		}
+
+		CNI(utf8_decode)
+
+		std::string utf8_encode(const uwstring_t &str, const numeric &policy) {
+			return utf8_transcode::encode(str, make_policy(policy));
+		}
+
+		CNI(utf8_encode)
+
+		// Byte offset of the first malformed sequence, -1 when str is valid UTF-8
+		numeric utf8_validate(const std::string &str) {
+			size_t offset = utf8_transcode::validate(str);
+			if (offset == std::string_view::npos) return -1;
+			return offset;
+		}
+
+		CNI(utf8_validate)
+
+		uwstring_t gbk_decode(const std::string &str, const numeric &policy) {
+			return gbk_codec::decode(str, gbk_codec::variant::gbk, make_policy(policy));
+		}
+
+		CNI(gbk_decode)
+
+		// Code points without a GBK code become '?' under the replace policy
+		std::string gbk_encode(const uwstring_t &str, const numeric &policy) {
+			return gbk_codec::encode(str, gbk_codec::variant::gbk, make_policy(policy));
+		}
+
+		CNI(gbk_encode)
+
+		uwstring_t gb18030_decode(const std::string &str, const numeric &policy) {
+			return gbk_codec::decode(str, gbk_codec::variant::gb18030, make_policy(policy));
+		}
+
+		CNI(gb18030_decode)
+
+		std::string gb18030_encode(const uwstring_t &str, const numeric &policy) {
+			return gbk_codec::encode(str, gbk_codec::variant::gb18030, make_policy(policy));
+		}
+
+		CNI(gb18030_encode)
 	}
 
+	// Classes and case mappings come from the Unicode tables in unicode_class.hpp and do not depend on the locale
 	CNI_NAMESPACE(wchar)
 	{
 		bool isalnum(uwchar_t c) {
-			return std::iswalnum(c);
+			return unicode_class::is(c, unicode_class::alnum);
 		}
 
 		CNI(isalnum)
 
 		bool isalpha(uwchar_t c) {
-			return std::iswalpha(c);
+			return unicode_class::is(c, unicode_class::alpha);
 		}
 
 		CNI(isalpha)
 
 		bool islower(uwchar_t c) {
-			return std::iswlower(c);
+			return unicode_class::is(c, unicode_class::lower);
 		}
 
 		CNI(islower)
 
 		bool isupper(uwchar_t c) {
-			return std::iswupper(c);
+			return unicode_class::is(c, unicode_class::upper);
 		}
 
 		CNI(isupper)
 
 		bool isdigit(uwchar_t c) {
-			return std::iswdigit(c);
+			return unicode_class::is(c, unicode_class::digit);
 		}
 
 		CNI(isdigit)
 
 		bool iscntrl(uwchar_t c) {
-			return std::iswcntrl(c);
+			return unicode_class::is(c, unicode_class::cntrl);
 		}
 
 		CNI(iscntrl)
 
 		bool isgraph(uwchar_t c) {
-			return std::iswgraph(c);
+			return unicode_class::is(c, unicode_class::graph);
 		}
 
 		CNI(isgraph)
 
 		bool isspace(uwchar_t c) {
-			return std::iswspace(c);
+			return unicode_class::is(c, unicode_class::space);
 		}
 
 		CNI(isspace)
 
 		bool isblank(uwchar_t c) {
-			return std::iswblank(c);
+			return unicode_class::is(c, unicode_class::blank);
 		}
 
 		CNI(isblank)
 
 		bool isprint(uwchar_t c) {
-			return std::iswprint(c);
+			return unicode_class::is(c, unicode_class::print);
 		}
 
 		CNI(isprint)
 
 		bool ispunct(uwchar_t c) {
-			return std::iswpunct(c);
+			return unicode_class::is(c, unicode_class::punct);
 		}
 
 		CNI(ispunct)
 
+		// Decimal digits of every script, where isdigit is only 0-9
+		bool isdecimal(uwchar_t c) {
+			return unicode_class::is(c, unicode_class::decimal);
+		}
+
+		CNI(isdecimal)
+
+		bool isidentifier(uwchar_t c) {
+			return unicode_class::is(c, unicode_class::id_continue);
+		}
+
+		CNI(isidentifier)
+
+		bool isidentifier_start(uwchar_t c) {
+			return unicode_class::is(c, unicode_class::id_start);
+		}
+
+		CNI(isidentifier_start)
+
+		// Bitmask of the classes of c, tested against the constants below
+		numeric classify(uwchar_t c) {
+			return unicode_class::flags_of(c);
+		}
+
+		CNI(classify)
+
+		CNI_REGISTER(alpha, var::make_constant<numeric>(int(unicode_class::alpha)))
+
+		CNI_REGISTER(digit, var::make_constant<numeric>(int(unicode_class::digit)))
+
+		CNI_REGISTER(decimal, var::make_constant<numeric>(int(unicode_class::decimal)))
+
+		CNI_REGISTER(alnum, var::make_constant<numeric>(int(unicode_class::alnum)))
+
+		CNI_REGISTER(upper, var::make_constant<numeric>(int(unicode_class::upper)))
+
+		CNI_REGISTER(lower, var::make_constant<numeric>(int(unicode_class::lower)))
+
+		CNI_REGISTER(space, var::make_constant<numeric>(int(unicode_class::space)))
+
+		CNI_REGISTER(blank, var::make_constant<numeric>(int(unicode_class::blank)))
+
+		CNI_REGISTER(cntrl, var::make_constant<numeric>(int(unicode_class::cntrl)))
+
+		CNI_REGISTER(punct, var::make_constant<numeric>(int(unicode_class::punct)))
+
+		CNI_REGISTER(graph, var::make_constant<numeric>(int(unicode_class::graph)))
+
+		CNI_REGISTER(print, var::make_constant<numeric>(int(unicode_class::print)))
+
+		CNI_REGISTER(identifier_start, var::make_constant<numeric>(int(unicode_class::id_start)))
+
+		CNI_REGISTER(identifier, var::make_constant<numeric>(int(unicode_class::id_continue)))
+
 		uwchar_t tolower(uwchar_t c) {
-			return std::towlower(c);
+			return unicode_class::to_lower(c);
 		}
 
 		CNI(tolower)
 
 		uwchar_t toupper(uwchar_t c) {
-			return std::towupper(c);
+			return unicode_class::to_upper(c);
 		}
 
 		CNI(toupper)
@@ -415,21 +424,38 @@ CNI_ROOT_NAMESPACE {
 		CNI_VISITOR(size)
 
 		uwstring_t tolower(const uwstring_t &str) {
-			uwstring_t s;
-			for (auto &ch : str) s.push_back(std::towlower(ch));
-			return std::move(s);
+			return unicode_class::to_lower(str);
 		}
 
 		CNI(tolower)
 
 		uwstring_t toupper(const uwstring_t &str) {
-			uwstring_t s;
-			for (auto &ch : str) s.push_back(std::towupper(ch));
-			return std::move(s);
+			return unicode_class::to_upper(str);
 		}
 
 		CNI(toupper)
 
+		// Class bitmask of every character, as wchar.classify gives for one
+		array classify(const uwstring_t &str) {
+			std::vector<uint16_t> flags(str.size());
+			unicode_class::classify(str, flags.data());
+			array arr;
+			for (uint16_t f : flags) arr.push_back(var::make<numeric>(f));
+			return arr;
+		}
+
+		CNI(classify)
+
+		// Number of characters having any class in mask
+		numeric count_class(const uwstring_t &str, const numeric &mask) {
+			const uint16_t bits = mask.as_integer();
+			size_t count = 0;
+			for (auto ch : str) count += unicode_class::is(ch, bits);
+			return count;
+		}
+
+		CNI(count_class)
+
 		numeric to_number(const uwstring_t &str, const codecvt_t &cvt) {
 			return parse_number(cvt->wide2local(str));
 		}
@@ -437,61 +463,325 @@ CNI_ROOT_NAMESPACE {
 		CNI(to_number)
 
 		array split(const uwstring_t &str, const array &signals) {
+			// Resolve the separator types once instead of per character
+			std::vector<uwchar_t> seps;
+			seps.reserve(signals.size());
+			for (auto &sig : signals) {
+				if (sig.type() == typeid(char))
+					seps.push_back(static_cast<unsigned char>(sig.const_val<char>()));
+				else if (sig.type() == typeid(uwchar_t))
+					seps.push_back(sig.const_val<uwchar_t>());
+			}
 			array arr;
-			uwstring_t buf;
-			bool found = false;
-			for (auto &ch : str) {
-				for (auto &sig : signals) {
-					if (sig.type() == typeid(char) && ch == sig.const_val<char>()) {
-						if (!buf.empty()) {
-							arr.push_back(buf);
-							buf.clear();
-						}
-						found = true;
-						break;
-					}
-					else if (sig.type() == typeid(uwchar_t) &&
-					         ch == sig.const_val<uwchar_t>()) {
-						if (!buf.empty()) {
-							arr.push_back(buf);
-							buf.clear();
-						}
-						found = true;
-						break;
-					}
+			std::size_t begin = 0;
+			for (std::size_t i = 0; i < str.size(); ++i) {
+				if (std::find(seps.begin(), seps.end(), str[i]) != seps.end()) {
+					if (i > begin) arr.push_back(str.substr(begin, i - begin));
+					begin = i + 1;
 				}
-				if (found)
-					found = false;
-				else
-					buf.push_back(ch);
 			}
-			if (!buf.empty()) arr.push_back(buf);
+			if (str.size() > begin) arr.push_back(str.substr(begin));
 			return std::move(arr);
 		}
 
 		CNI(split)
 	}
 
+	// Matched in place and shared with the results that outlive the call, never copied
+	using wsubject_ref = script_subject<uwstring_t>;
+
 	CNI_NAMESPACE(wregex)
 	{
-		pcre2_smatch match(pcre2_regex_t & reg, const uwstring_t &str) {
-			return pcre2_regex_match(reg, str, PCRE2_ANCHORED | PCRE2_ENDANCHORED);
+		hash_map stats(const pcre2_regex_t &reg) {
+			return make_stats_map(reg->pattern, reg->mode(), reg->stats.read());
+		}
+
+		CNI(stats)
+
+		string mode(const pcre2_regex_t &reg) {
+			return reg->mode();
+		}
+
+		CNI(mode)
+
+		pcre2_smatch match(pcre2_regex_t & reg, const var &str) {
+			wsubject_ref subject(str);
+			return subject.bind(pcre2_regex_match(reg, subject.view(), PCRE2_ANCHORED | PCRE2_ENDANCHORED));
 		}
 
 		CNI(match)
 
-		pcre2_smatch search(pcre2_regex_t &reg, const uwstring_t &str) {
-			return pcre2_regex_match(reg, str, 0);
+		pcre2_smatch search(pcre2_regex_t &reg, const var &str) {
+			wsubject_ref subject(str);
+			return subject.bind(pcre2_regex_match(reg, subject.view(), 0));
 		}
 
 		CNI(search)
 
+		pcre2_smatch search_from(pcre2_regex_t &reg, const var &str, numeric start) {
+			if (start.as_integer() < 0) throw lang_error("Start offset must be non-negative.");
+			wsubject_ref subject(str);
+			return subject.bind(pcre2_regex_match(reg, subject.view(), 0, start.as_integer()));
+		}
+
+		CNI(search_from)
+
+		bool test(pcre2_regex_t &reg, const uwstring_t &str) {
+			return pcre2_regex_find_pos(*reg, str).first != PCRE2_UNSET;
+		}
+
+		CNI(test)
+
+		pair find_pos(pcre2_regex_t &reg, const uwstring_t &str, numeric start) {
+			if (start.as_integer() < 0) throw lang_error("Start offset must be non-negative.");
+			auto [begin, end] = pcre2_regex_find_pos(*reg, str, start.as_integer());
+			if (begin == PCRE2_UNSET)
+				return pair(var::make<numeric>(-1), var::make<numeric>(-1));
+			return pair(var::make<numeric>(begin), var::make<numeric>(end));
+		}
+
+		CNI(find_pos)
+
+		numeric count(pcre2_regex_t &reg, const uwstring_t &str) {
+			return pcre2_regex_count(*reg, str);
+		}
+
+		CNI(count)
+
+		array find_all(pcre2_regex_t &reg, const var &str) {
+			wsubject_ref subject(str);
+			array arr;
+			for (auto &m : pcre2_regex_find_all(*reg, subject.view()))
+				arr.push_back(var::make<pcre2_smatch>(subject.bind(std::move(m))));
+			return arr;
+		}
+
+		CNI(find_all)
+
+		pcre2_regex_iterator iterate(pcre2_regex_t &reg, const var &str) {
+			return pcre2_regex_iterator(reg, wsubject_ref(str).share());
+		}
+
+		CNI(iterate)
+
+		std::vector<pcre2_stl_string_view> batch_subjects(const array &strs) {
+			std::vector<pcre2_stl_string_view> subjects;
+			subjects.reserve(strs.size());
+			for (auto &it : strs) {
+				if (it.type() != typeid(uwstring_t))
+					throw lang_error("Regex batch accepts wstrings only.");
+				subjects.emplace_back(it.const_val<uwstring_t>());
+			}
+			return subjects;
+		}
+
+		array search_batch(pcre2_regex_t &reg, const array &strs, numeric threads) {
+			if (threads.as_integer() < 0) throw lang_error("Thread count must be non-negative.");
+			std::vector<PCRE2_SIZE> positions;
+			pcre2_regex_search_batch(*reg, batch_subjects(strs), 0, threads.as_integer(), positions);
+			array arr(positions.size());
+			for (size_t i = 0; i < positions.size(); ++i)
+				arr[i] = var::make<numeric>(positions[i] == PCRE2_UNSET ? -1 : static_cast<numeric_integer>(positions[i]));
+			return arr;
+		}
+
+		CNI(search_batch)
+
+		array match_batch(pcre2_regex_t &reg, const array &strs, numeric threads) {
+			if (threads.as_integer() < 0) throw lang_error("Thread count must be non-negative.");
+			std::vector<PCRE2_SIZE> positions;
+			pcre2_regex_search_batch(*reg, batch_subjects(strs), PCRE2_ANCHORED | PCRE2_ENDANCHORED, threads.as_integer(), positions);
+			array arr(positions.size());
+			for (size_t i = 0; i < positions.size(); ++i)
+				arr[i] = var::make<bool>(positions[i] != PCRE2_UNSET);
+			return arr;
+		}
+
+		CNI(match_batch)
+
+		pcre2_regex_parallel make_parallel(pcre2_regex_t &reg, numeric overlap, numeric threads) {
+			if (overlap.as_integer() < 0) throw lang_error("Overlap must be non-negative.");
+			if (threads.as_integer() < 0) throw lang_error("Thread count must be non-negative.");
+			return pcre2_regex_parallel(reg, overlap.as_integer(), threads.as_integer());
+		}
+
+		pcre2_smatch search_parallel(pcre2_regex_t &reg, const var &str, numeric overlap, numeric threads) {
+			wsubject_ref subject(str);
+			return subject.bind(make_parallel(reg, overlap, threads).search(subject.view()));
+		}
+
+		CNI(search_parallel)
+
+		array find_all_parallel(pcre2_regex_t &reg, const var &str, numeric overlap, numeric threads) {
+			wsubject_ref subject(str);
+			array arr;
+			for (auto &m : make_parallel(reg, overlap, threads).find_all(subject.view()))
+				arr.push_back(var::make<pcre2_smatch>(subject.bind(std::move(m))));
+			return arr;
+		}
+
+		CNI(find_all_parallel)
+
+		array split(pcre2_regex_t &reg, const uwstring_t &str, numeric limit) {
+			if (limit.as_integer() < 0) throw lang_error("Split limit must be non-negative.");
+			thread_local std::vector<std::pair<size_t, size_t>> pieces;
+			pcre2_regex_split(*reg, str, limit.as_integer(), pieces);
+			array arr(pieces.size());
+			for (size_t i = 0; i < pieces.size(); ++i) {
+				auto [start, end] = pieces[i];
+				if (start == PCRE2_UNSET)
+					arr[i] = var::make<uwstring_t>();
+				else
+					arr[i] = var::make<uwstring_t>(str, start, end - start);
+			}
+			return arr;
+		}
+
+		CNI(split)
+
+		pcre2_regex_stream stream(pcre2_regex_t &reg) {
+			return pcre2_regex_stream(reg);
+		}
+
+		CNI(stream)
+
 		uwstring_t replace(pcre2_regex_t &reg, const uwstring_t &str,
 		                   const uwstring_t &fmt) {
 			return pcre2_regex_replace(reg, str, fmt);
 		}
 
 		CNI(replace)
+
+		uwstring_t replace_with(pcre2_regex_t &reg, const var &str, const var &func) {
+			wsubject_ref subject(str);
+			return pcre2_regex_replace_with(reg, subject.view(), [&subject] { return subject.share(); }, [&func](const pcre2_smatch &m, uwstring_t &out) {
+				var rep = invoke(func, var::make<pcre2_smatch>(m));
+				if (rep.type() != typeid(uwstring_t))
+					throw lang_error("Replacement callback must return a wstring.");
+				out.append(rep.const_val<uwstring_t>());
+			});
+		}
+
+		CNI(replace_with)
+
+		uwstring_t replace_ex(pcre2_regex_t &reg, const uwstring_t &str,
+		                      const uwstring_t &fmt, numeric flags) {
+			return pcre2_regex_replace(reg, str, fmt, pcre2_replace_option(flags.as_integer()));
+		}
+
+		CNI(replace_ex)
+
+		numeric replace_append(pcre2_regex_t &reg, uwstring_t &out, const uwstring_t &str,
+		                       const uwstring_t &fmt, numeric flags) {
+			return pcre2_regex_replace_to(reg, str, fmt, out, pcre2_replace_option(flags.as_integer()));
+		}
+
+		CNI(replace_append)
+
+		CNI_REGISTER(replace_first, var::make_constant<numeric>(1))
+
+		CNI_REGISTER(replace_literal, var::make_constant<numeric>(2))
+	}
+
+	CNI_NAMESPACE(wregex_iterator)
+	{
+		bool next(pcre2_regex_iterator &it) {
+			return it.next();
+		}
+
+		CNI(next)
+
+		pcre2_smatch result(const pcre2_regex_iterator &it) {
+			return it.current;
+		}
+
+		CNI(result)
+	}
+
+	CNI_NAMESPACE(wregex_set)
+	{
+		array matches(const pcre2_regex_set_t &set, const uwstring_t &str) {
+			array arr;
+			for (std::size_t idx : set->matches(str)) arr.push_back(var::make<numeric>(idx));
+			return arr;
+		}
+
+		CNI(matches)
+
+		pair first(const pcre2_regex_set_t &set, const var &str) {
+			wsubject_ref subject(str);
+			auto [idx, m] = set->first(subject.view());
+			return pair(var::make<numeric>(idx), var::make<pcre2_smatch>(subject.bind(std::move(m))));
+		}
+
+		CNI(first)
+
+		numeric size(const pcre2_regex_set_t &set) {
+			return set->size();
+		}
+
+		CNI(size)
+	}
+
+	CNI_NAMESPACE(wregex_stream)
+	{
+		array feed(pcre2_regex_stream &st, const uwstring_t &chunk) {
+			array arr;
+			for (auto &m : st.feed(chunk)) arr.push_back(var::make<pcre2_smatch>(std::move(m)));
+			return arr;
+		}
+
+		CNI(feed)
+
+		array finish(pcre2_regex_stream &st) {
+			array arr;
+			for (auto &m : st.finish()) arr.push_back(var::make<pcre2_smatch>(std::move(m)));
+			return arr;
+		}
+
+		CNI(finish)
+
+		numeric offset(const pcre2_regex_stream &st) {
+			return st.offset();
+		}
+
+		CNI(offset)
+
+		void set_max_buffer(pcre2_regex_stream &st, const numeric &size) {
+			if (size.as_integer() <= 0) throw lang_error("Stream buffer limit must be positive.");
+			st.max_buffer = size.as_integer();
+		}
+
+		CNI(set_max_buffer)
+	}
+
+	CNI_NAMESPACE(wregex_cache)
+	{
+		hash_map stats() {
+			auto s = pcre2_regex_cache::instance().stats();
+			hash_map map;
+			map.emplace(var::make<string>("hits"), var::make<numeric>(s.hits));
+			map.emplace(var::make<string>("misses"), var::make<numeric>(s.misses));
+			map.emplace(var::make<string>("evictions"), var::make<numeric>(s.evictions));
+			map.emplace(var::make<string>("size"), var::make<numeric>(s.size));
+			map.emplace(var::make<string>("capacity"), var::make<numeric>(s.capacity));
+			return map;
+		}
+
+		CNI(stats)
+
+		void set_capacity(const numeric &capacity) {
+			if (capacity.as_integer() < 0) throw lang_error("Cache capacity must be non-negative.");
+			pcre2_regex_cache::instance().set_capacity(capacity.as_integer());
+		}
+
+		CNI(set_capacity)
+
+		void clear() {
+			pcre2_regex_cache::instance().clear();
+		}
+
+		CNI(clear)
 	}
 
 	CNI_NAMESPACE(wsmatch)
@@ -521,6 +811,7 @@ CNI_ROOT_NAMESPACE {
 		CNI(length)
 
 		numeric position(const pcre2_smatch &m, numeric index) {
+			if (!m.matched(index.as_integer())) return -1;
 			return m.position(index.as_integer());
 		}
 
@@ -533,16 +824,33 @@ CNI_ROOT_NAMESPACE {
 		CNI(str)
 
 		uwstring_t prefix(const pcre2_smatch &m) {
-			return m.prefix();
+			return uwstring_t(m.prefix());
 		}
 
 		CNI(prefix)
 
 		uwstring_t suffix(const pcre2_smatch &m) {
-			return m.suffix();
+			return uwstring_t(m.suffix());
 		}
 
 		CNI(suffix)
+
+		uwstring_t named(const pcre2_smatch &m, const uwstring_t &name) {
+			return uwstring_t(m.named(name));
+		}
+
+		CNI(named)
+
+		hash_map to_map(const pcre2_smatch &m) {
+			hash_map map;
+			if (m.names) {
+				for (auto &entry : *m.names)
+					map.emplace(var::make<uwstring_t>(entry.first), var::make<uwstring_t>(m.named(entry.first)));
+			}
+			return map;
+		}
+
+		CNI(to_map)
 	}
 
 	var make_wstring()
@@ -555,17 +863,132 @@ CNI_ROOT_NAMESPACE {
 
 	pcre2_regex_t build_wregex(const uwstring_t &str)
 	{
-		return std::make_shared<pcre2_regex>(str, false);
+		return pcre2_regex_cache::instance().get(str, false);
 	}
 
 	CNI(build_wregex)
 
 	pcre2_regex_t build_optimize_wregex(const uwstring_t &str)
 	{
-		return std::make_shared<pcre2_regex>(str, true);
+		return pcre2_regex_cache::instance().get(str, true);
 	}
 
 	CNI(build_optimize_wregex)
+
+	pcre2_regex_t build_dfa_wregex(const uwstring_t &str)
+	{
+		pcre2_regex_config config;
+		config.dfa = true;
+		return pcre2_regex_cache::instance().get(str, config);
+	}
+
+	CNI(build_dfa_wregex)
+
+	// Takes the same options map as regex.build_ex
+	pcre2_regex_t build_ex_wregex(const uwstring_t &str, const hash_map &opts)
+	{
+		pcre2_regex_config config;
+		parse_regex_options(opts, config);
+		return pcre2_regex_cache::instance().get(str, config);
+	}
+
+	CNI(build_ex_wregex)
+
+	pcre2_regex_set_t build_wregex_set(const array &patterns)
+	{
+		auto set = std::make_shared<pcre2_regex_set>();
+		for (auto &it : patterns) {
+			if (it.type() == typeid(uwstring_t))
+				set->add(pcre2_regex_cache::instance().get(it.const_val<uwstring_t>(), true));
+			else if (it.type() == typeid(pcre2_regex_t))
+				set->add(it.const_val<pcre2_regex_t>());
+			else
+				throw lang_error("Regex set accepts wstrings or wregexes only.");
+		}
+		set->prepare();
+		return set;
+	}
+
+	CNI(build_wregex_set)
+
+	void save_wregex_set(const string &path, const array &regexes)
+	{
+		std::vector<pcre2_regex_t> regs;
+		regs.reserve(regexes.size());
+		for (auto &it : regexes) {
+			if (it.type() == typeid(uwstring_t))
+				regs.push_back(pcre2_regex_cache::instance().get(it.const_val<uwstring_t>(), true));
+			else if (it.type() == typeid(pcre2_regex_t))
+				regs.push_back(it.const_val<pcre2_regex_t>());
+			else
+				throw lang_error("Regex bundle accepts wstrings or wregexes only.");
+		}
+		std::string bytes = pcre2_regex_bundle::save(regs);
+		std::ofstream out(path, std::ios::binary | std::ios::trunc);
+		if (!out.write(bytes.data(), bytes.size()))
+			throw lang_error("Failed to write regex bundle: " + path);
+	}
+
+	CNI(save_wregex_set)
+
+	array load_wregex_set(const string &path)
+	{
+		mapped_file file(path);
+		std::vector<pcre2_regex_t> regs;
+		// A damaged bundle is reported to the script, which can rebuild the set from its patterns
+		try {
+			regs = pcre2_regex_bundle::load(file.view());
+		}
+		catch (const std::runtime_error &e) {
+			throw lang_error(e.what());
+		}
+		array arr;
+		for (auto &reg : regs) {
+			pcre2_regex_cache::instance().insert(reg);
+			arr.push_back(var::make<pcre2_regex_t>(std::move(reg)));
+		}
+		return arr;
+	}
+
+	CNI(load_wregex_set)
+
+	// Counting is off by default, it costs a clock read per match while on
+	void enable_wregex_stats(bool on)
+	{
+		match_stats::enable(on);
+	}
+
+	CNI(enable_wregex_stats)
+
+	void reset_wregex_stats()
+	{
+		pcre2_regex_reset_stats();
+	}
+
+	CNI(reset_wregex_stats)
+
+	// Every live wregex that has been called, most time spent first
+	array wregex_stats()
+	{
+		array arr;
+		for (auto &entry : pcre2_regex_top_stats())
+			arr.push_back(var::make<hash_map>(make_stats_map(entry.pattern, entry.mode, entry.stats)));
+		return arr;
+	}
+
+	CNI(wregex_stats)
+
+	array top_wregex(const numeric &n)
+	{
+		if (n.as_integer() <= 0)
+			return array();
+		array arr;
+		for (auto &entry : pcre2_regex_top_stats(n.as_integer()))
+			arr.push_back(var::make<hash_map>(make_stats_map(entry.pattern, entry.mode, entry.stats)));
+		return arr;
+	}
+
+	CNI(top_wregex)
 }
 
 CNI_ENABLE_TYPE_EXT_V(codecvt, codecvt_t, "unicode::codecvt")
@@ -573,3 +996,303 @@ CNI_ENABLE_TYPE_EXT_V(wchar, uwchar_t, "unicode::wchar")
 CNI_ENABLE_TYPE_EXT_V(wstring_type, uwstring_t, "unicode::wstring")
 CNI_ENABLE_TYPE_EXT_V(wregex, pcre2_regex_t, "unicode::wregex")
 CNI_ENABLE_TYPE_EXT_V(wsmatch, pcre2_smatch, "unicode::wregex::result")
+CNI_ENABLE_TYPE_EXT_V(wregex_set, pcre2_regex_set_t, "unicode::wregex::set")
+CNI_ENABLE_TYPE_EXT_V(wregex_stream, pcre2_regex_stream, "unicode::wregex::stream")
+CNI_ENABLE_TYPE_EXT_V(wregex_iterator, pcre2_regex_iterator, "unicode::wregex::iterator")
+
+// Regexes over UTF-8 strings. They are compiled with the 8-bit library and match the script string in place,
+// so neither a UTF-32 copy nor any other copy of the subject is made. Results give byte offsets, and code
+// point offsets through char_*.
+#undef PCRE2_CODE_UNIT_WIDTH
+#undef pcre2_stl_string
+#undef pcre2_stl_string_view
+#define PCRE2_CODE_UNIT_WIDTH 8
+#define pcre2_stl_string std::string
+#define pcre2_stl_string_view std::string_view
+
+#include "pcre2.hpp"
+#include "utf8_index.hpp"
+
+// Code point offsets of byte offsets into one UTF-8 subject. Each query counts on from the previous one,
+// so the ascending queries of a find_all take linear time overall.
+class utf8_char_counter {
+	std::string_view text;
+	size_t byte = 0;
+	size_t chars = 0;
+
+public:
+	explicit utf8_char_counter(std::string_view text_v) : text(text_v) {}
+
+	size_t operator()(size_t offset)
+	{
+		offset = std::min(offset, text.size());
+		for (; byte < offset; ++byte)
+			chars += (text[byte] & 0xC0) != 0x80;
+		for (; byte > offset; --byte)
+			chars -= (text[byte - 1] & 0xC0) != 0x80;
+		return chars;
+	}
+};
+
+// Match over a UTF-8 subject, with the code point offsets of every group next to its byte offsets
+struct u8smatch {
+	pcre2_smatch match;
+	std::vector<std::pair<size_t, size_t>> chars;
+
+	u8smatch() = default;
+
+	u8smatch(pcre2_smatch match_v, utf8_char_counter &counter) : match(std::move(match_v))
+	{
+		chars.reserve(match.offsets.size());
+		for (auto [start, end] : match.offsets) {
+			if (start == PCRE2_UNSET) {
+				chars.emplace_back(PCRE2_UNSET, PCRE2_UNSET);
+				continue;
+			}
+			size_t char_start = counter(start);
+			chars.emplace_back(char_start, counter(end));
+		}
+	}
+};
+
+CNI_ROOT_NAMESPACE {
+	using namespace cs;
+
+	using u8subject_ref = script_subject<string>;
+
+	u8smatch make_u8match(pcre2_smatch m)
+	{
+		utf8_char_counter counter(m.input());
+		return u8smatch(std::move(m), counter);
+	}
+
+	CNI_NAMESPACE(u8regex)
+	{
+		string mode(const pcre2_regex_t &reg) {
+			return reg->mode();
+		}
+
+		CNI(mode)
+
+		u8smatch match(pcre2_regex_t &reg, const var &str) {
+			u8subject_ref subject(str);
+			return make_u8match(subject.bind(pcre2_regex_match(reg, subject.view(), PCRE2_ANCHORED | PCRE2_ENDANCHORED)));
+		}
+
+		CNI(match)
+
+		u8smatch search(pcre2_regex_t &reg, const var &str) {
+			u8subject_ref subject(str);
+			return make_u8match(subject.bind(pcre2_regex_match(reg, subject.view(), 0)));
+		}
+
+		CNI(search)
+
+		// start is a byte offset
+		u8smatch search_from(pcre2_regex_t &reg, const var &str, numeric start) {
+			if (start.as_integer() < 0) throw lang_error("Start offset must be non-negative.");
+			u8subject_ref subject(str);
+			return make_u8match(subject.bind(pcre2_regex_match(reg, subject.view(), 0, start.as_integer())));
+		}
+
+		CNI(search_from)
+
+		bool test(pcre2_regex_t &reg, const string &str) {
+			return pcre2_regex_find_pos(*reg, str).first != PCRE2_UNSET;
+		}
+
+		CNI(test)
+
+		numeric count(pcre2_regex_t &reg, const string &str) {
+			return pcre2_regex_count(*reg, str);
+		}
+
+		CNI(count)
+
+		array find_all(pcre2_regex_t &reg, const var &str) {
+			u8subject_ref subject(str);
+			utf8_char_counter counter(subject.view());
+			array arr;
+			for (auto &m : pcre2_regex_find_all(*reg, subject.view()))
+				arr.push_back(var::make<u8smatch>(u8smatch(subject.bind(std::move(m)), counter)));
+			return arr;
+		}
+
+		CNI(find_all)
+
+		string replace(pcre2_regex_t &reg, const string &str, const string &fmt) {
+			return pcre2_regex_replace(reg, str, fmt);
+		}
+
+		CNI(replace)
+	}
+
+	CNI_NAMESPACE(u8smatch_type)
+	{
+		bool ready(const u8smatch &m) {
+			return m.match.ready;
+		}
+
+		CNI(ready)
+
+		bool empty(const u8smatch &m) {
+			return m.match.empty();
+		}
+
+		CNI(empty)
+
+		numeric size(const u8smatch &m) {
+			return m.match.size();
+		}
+
+		CNI(size)
+
+		string str(const u8smatch &m, numeric index) {
+			return string(m.match.str(index.as_integer()));
+		}
+
+		CNI(str)
+
+		// The group decoded to a wstring, without widening the rest of the subject
+		uwstring_t wstr(const u8smatch &m, numeric index) {
+			return utf8_transcode::decode(m.match.str(index.as_integer()));
+		}
+
+		CNI(wstr)
+
+		numeric position(const u8smatch &m, numeric index) {
+			if (!m.match.matched(index.as_integer())) return -1;
+			return m.match.position(index.as_integer());
+		}
+
+		CNI(position)
+
+		numeric length(const u8smatch &m, numeric index) {
+			return m.match.length(index.as_integer());
+		}
+
+		CNI(length)
+
+		numeric char_position(const u8smatch &m, numeric index) {
+			if (!m.match.matched(index.as_integer())) return -1;
+			return m.chars[index.as_integer()].first;
+		}
+
+		CNI(char_position)
+
+		numeric char_length(const u8smatch &m, numeric index) {
+			if (!m.match.matched(index.as_integer())) return 0;
+			auto [start, end] = m.chars[index.as_integer()];
+			return end - start;
+		}
+
+		CNI(char_length)
+
+		string prefix(const u8smatch &m) {
+			return string(m.match.prefix());
+		}
+
+		CNI(prefix)
+
+		string suffix(const u8smatch &m) {
+			return string(m.match.suffix());
+		}
+
+		CNI(suffix)
+
+		string named(const u8smatch &m, const string &name) {
+			return string(m.match.named(name));
+		}
+
+		CNI(named)
+	}
+
+	// Code point access to a UTF-8 string without widening all of it; offsets agree with wstring indexes
+	CNI_NAMESPACE(utf8_index_type)
+	{
+		numeric size(const utf8_index &idx) {
+			return idx.size();
+		}
+
+		CNI(size)
+
+		numeric bytes(const utf8_index &idx) {
+			return idx.bytes();
+		}
+
+		CNI(bytes)
+
+		numeric byte_to_char(const utf8_index &idx, numeric byte) {
+			if (byte.as_integer() < 0) throw lang_error("Byte offset must be non-negative.");
+			return idx.byte_to_char(byte.as_integer());
+		}
+
+		CNI(byte_to_char)
+
+		numeric char_to_byte(const utf8_index &idx, numeric index) {
+			if (index.as_integer() < 0) throw lang_error("Character offset must be non-negative.");
+			return idx.char_to_byte(index.as_integer());
+		}
+
+		CNI(char_to_byte)
+
+		string substr(const utf8_index &idx, numeric index, numeric count) {
+			if (index.as_integer() < 0 || count.as_integer() < 0)
+				throw lang_error("Character offset and count must be non-negative.");
+			return string(idx.substr(index.as_integer(), count.as_integer()));
+		}
+
+		CNI(substr)
+
+		uwstring_t wsubstr(const utf8_index &idx, numeric index, numeric count) {
+			if (index.as_integer() < 0 || count.as_integer() < 0)
+				throw lang_error("Character offset and count must be non-negative.");
+			return utf8_transcode::decode(idx.substr(index.as_integer(), count.as_integer()));
+		}
+
+		CNI(wsubstr)
+
+		uwchar_t at(const utf8_index &idx, numeric index) {
+			if (index.as_integer() < 0 || size_t(index.as_integer()) >= idx.size())
+				throw lang_error("Character offset out of range.");
+			std::u32string ch = utf8_transcode::decode(idx.substr(index.as_integer(), 1));
+			return ch.at(0);
+		}
+
+		CNI(at)
+	}
+
+	utf8_index build_utf8_index(const var &str)
+	{
+		return utf8_index(u8subject_ref(str).share());
+	}
+
+	CNI(build_utf8_index)
+
+	pcre2_regex_t build_u8regex(const string &str)
+	{
+		return pcre2_regex_cache::instance().get(str, false);
+	}
+
+	CNI(build_u8regex)
+
+	pcre2_regex_t build_optimize_u8regex(const string &str)
+	{
+		return pcre2_regex_cache::instance().get(str, true);
+	}
+
+	CNI(build_optimize_u8regex)
+
+	pcre2_regex_t build_ex_u8regex(const string &str, const hash_map &opts)
+	{
+		pcre2_regex_config config;
+		parse_regex_options(opts, config);
+		return pcre2_regex_cache::instance().get(str, config);
+	}
+
+	CNI(build_ex_u8regex)
+}
+
+CNI_ENABLE_TYPE_EXT_V(u8regex, pcre2_regex_t, "unicode::u8regex")
+CNI_ENABLE_TYPE_EXT_V(u8smatch_type, u8smatch, "unicode::u8regex::result")
+CNI_ENABLE_TYPE_EXT_V(utf8_index_type, utf8_index, "unicode::utf8_index")
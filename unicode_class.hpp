@@ -0,0 +1,63 @@
+#pragma once
+#include <string_view>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+#include "unicode_tables.hpp"
+
+// Locale-independent character classes and simple case mappings from the two-stage tables in
+// unicode_tables.hpp. A lookup is two table loads with no branch on the code point; values above U+10FFFF
+// behave as unassigned code points.
+namespace unicode_class {
+	inline const record &lookup(char32_t cp)
+	{
+		constexpr char32_t mask = (1 << block_shift) - 1;
+		const char32_t clamped = std::min<char32_t>(cp, 0x10FFFF);
+		return records[block_data[size_t(block_index[clamped >> block_shift]) << block_shift | (clamped & mask)]];
+	}
+
+	inline uint16_t flags_of(char32_t cp)
+	{
+		return lookup(cp).flags;
+	}
+
+	// True if cp has any of the flags in mask
+	inline bool is(char32_t cp, uint16_t mask)
+	{
+		return (lookup(cp).flags & mask) != 0;
+	}
+
+	inline char32_t to_lower(char32_t cp)
+	{
+		return cp + lookup(cp).lower;
+	}
+
+	inline char32_t to_upper(char32_t cp)
+	{
+		return cp + lookup(cp).upper;
+	}
+
+	// Flags of every code point of in, written to out which holds in.size() entries
+	inline void classify(std::u32string_view in, uint16_t *out)
+	{
+		for (size_t i = 0; i < in.size(); ++i)
+			out[i] = flags_of(in[i]);
+	}
+
+	inline std::u32string to_lower(std::u32string_view in)
+	{
+		std::u32string out(in.size(), 0);
+		for (size_t i = 0; i < in.size(); ++i)
+			out[i] = to_lower(in[i]);
+		return out;
+	}
+
+	inline std::u32string to_upper(std::u32string_view in)
+	{
+		std::u32string out(in.size(), 0);
+		for (size_t i = 0; i < in.size(); ++i)
+			out[i] = to_upper(in[i]);
+		return out;
+	}
+} // namespace unicode_class
@@ -0,0 +1,145 @@
+#pragma once
+#include <string_view>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "shared_subject.hpp"
+
+// Sampled map between byte offsets and code point offsets of one UTF-8 string. Built in one pass, it keeps
+// the code point count at every stride-th byte and the byte offset of every stride-th code point, so each
+// lookup scans at most one stride. A code point is counted at its lead byte, as PCRE2 and utf8_char_counter do.
+// The string is referenced rather than copied; once it is resized every lookup throws instead of answering
+// for text the samples no longer describe.
+class utf8_index {
+public:
+	using text_t = shared_subject<std::string>;
+
+	static constexpr size_t stride = 64;
+
+private:
+	text_t text;
+	size_t char_count = 0;
+	// Code points starting before byte k * stride
+	std::vector<size_t> chars_at_byte;
+	// Byte offset of code point k * stride
+	std::vector<size_t> bytes_at_char;
+
+	static bool is_lead(unsigned char c)
+	{
+		return (c & 0xC0) != 0x80;
+	}
+
+	// Written without branches so that the compiler vectorizes it
+	static size_t lead_bytes(const unsigned char *s, size_t n)
+	{
+		size_t count = 0;
+		for (size_t i = 0; i < n; ++i)
+			count += (s[i] & 0xC0) != 0x80;
+		return count;
+	}
+
+	const unsigned char *data() const
+	{
+		return reinterpret_cast<const unsigned char *>(text.view().data());
+	}
+
+public:
+	explicit utf8_index(text_t text_v) : text(std::move(text_v))
+	{
+		const unsigned char *s = data();
+		const size_t n = text.size();
+		// Never more code points than bytes
+		chars_at_byte.reserve(n / stride + 1);
+		bytes_at_char.reserve(n / stride + 1);
+		size_t chars = 0;
+		for (size_t block = 0; block < n; block += stride) {
+			chars_at_byte.push_back(chars);
+			const size_t end = std::min(block + stride, n);
+			const size_t count = lead_bytes(s + block, end - block);
+			// Only blocks holding a sampled code point are walked byte by byte
+			size_t next = (chars + stride - 1) / stride * stride;
+			if (next >= chars + count) {
+				chars += count;
+				continue;
+			}
+			for (size_t i = block; i < end; ++i) {
+				if (!is_lead(s[i]))
+					continue;
+				if (chars == next) {
+					bytes_at_char.push_back(i);
+					next += stride;
+				}
+				++chars;
+			}
+		}
+		char_count = chars;
+		// Offsets of pure ASCII are the same in both units
+		if (char_count == n) {
+			std::vector<size_t>().swap(chars_at_byte);
+			std::vector<size_t>().swap(bytes_at_char);
+		}
+	}
+
+	std::string_view str() const
+	{
+		return text.view();
+	}
+
+	// Code points in the string
+	size_t size() const
+	{
+		return char_count;
+	}
+
+	size_t bytes() const
+	{
+		return text.size();
+	}
+
+	bool ascii() const
+	{
+		return char_count == text.size();
+	}
+
+	// Code points starting before byte, which is the index of the code point starting there
+	size_t byte_to_char(size_t byte) const
+	{
+		text.check();
+		byte = std::min(byte, text.size());
+		if (ascii())
+			return byte;
+		const size_t block = byte / stride;
+		if (block == chars_at_byte.size())
+			return char_count;
+		return chars_at_byte[block] + lead_bytes(data() + block * stride, byte - block * stride);
+	}
+
+	// Byte offset where code point index starts, the string size past the last one
+	size_t char_to_byte(size_t index) const
+	{
+		text.check();
+		if (index >= char_count)
+			return text.size();
+		if (ascii())
+			return index;
+		const unsigned char *s = data();
+		const size_t n = text.size();
+		size_t i = bytes_at_char[index / stride];
+		for (size_t left = index % stride; left > 0; --left) {
+			++i;
+			while (i < n && !is_lead(s[i]))
+				++i;
+		}
+		return i;
+	}
+
+	// Bytes of count code points from index
+	std::string_view substr(size_t index, size_t count) const
+	{
+		const size_t begin = char_to_byte(index);
+		const size_t end = count >= char_count - std::min(index, char_count) ? text.size() : char_to_byte(index + count);
+		return str().substr(begin, end - begin);
+	}
+};
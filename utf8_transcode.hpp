@@ -0,0 +1,293 @@
+#pragma once
+#include <string_view>
+#include <stdexcept>
+#include <cstdint>
+#include <string>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define UTF8_TRANSCODE_AVX2
+#define UTF8_TRANSCODE_SSE2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define UTF8_TRANSCODE_SSE2
+#endif
+
+// UTF-8 <-> UTF-32 conversion with validation per Unicode Table 3-7: overlong forms, surrogates and code
+// points above U+10FFFF are rejected. Runs of ASCII are converted a SIMD block at a time.
+namespace utf8_transcode {
+	enum class error_policy {
+		// Throw transcode_error at the first invalid input
+		strict,
+		// Emit the replacement character for each maximal invalid subpart
+		replace,
+		// Drop invalid input
+		skip
+	};
+
+	constexpr char32_t replacement_character = 0xFFFD;
+
+	struct transcode_error : std::range_error {
+		// Byte offset for decoding, code point index for encoding
+		size_t offset;
+
+		transcode_error(const std::string &what, size_t offset_v) : std::range_error(what), offset(offset_v) {}
+	};
+
+	// Length of the well-formed sequence at s, or minus the length of its maximal invalid subpart
+	inline int sequence(const unsigned char *s, size_t remaining, char32_t &cp)
+	{
+		const unsigned char c = s[0];
+		int len;
+		unsigned char lo = 0x80, hi = 0xBF;
+		if (c >= 0xC2 && c <= 0xDF) {
+			len = 2;
+			cp = c & 0x1F;
+		}
+		else if (c >= 0xE0 && c <= 0xEF) {
+			len = 3;
+			cp = c & 0x0F;
+			if (c == 0xE0)
+				lo = 0xA0;
+			else if (c == 0xED)
+				hi = 0x9F;
+		}
+		else if (c >= 0xF0 && c <= 0xF4) {
+			len = 4;
+			cp = c & 0x07;
+			if (c == 0xF0)
+				lo = 0x90;
+			else if (c == 0xF4)
+				hi = 0x8F;
+		}
+		else {
+			return -1;
+		}
+		for (int k = 1; k < len; ++k) {
+			if (size_t(k) >= remaining || s[k] < lo || s[k] > hi)
+				return -k;
+			cp = cp << 6 | (s[k] & 0x3F);
+			lo = 0x80;
+			hi = 0xBF;
+		}
+		return len;
+	}
+
+	// Number of leading ASCII bytes
+	inline size_t ascii_prefix(const unsigned char *s, size_t n)
+	{
+		size_t i = 0;
+#if defined(UTF8_TRANSCODE_AVX2)
+		for (; i + 32 <= n; i += 32) {
+			if (_mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i))) != 0)
+				break;
+		}
+#elif defined(UTF8_TRANSCODE_SSE2)
+		for (; i + 16 <= n; i += 16) {
+			if (_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i))) != 0)
+				break;
+		}
+#endif
+		while (i < n && s[i] < 0x80)
+			++i;
+		return i;
+	}
+
+	// Widens whole blocks of ASCII until one holds another byte, returns the number of bytes consumed
+	inline size_t widen_ascii(const unsigned char *s, size_t n, char32_t *out)
+	{
+		size_t i = 0;
+#if defined(UTF8_TRANSCODE_AVX2)
+		for (; i + 16 <= n; i += 16) {
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+			if (_mm_movemask_epi8(v) != 0)
+				break;
+			__m256i *dst = reinterpret_cast<__m256i *>(out + i);
+			_mm256_storeu_si256(dst, _mm256_cvtepu8_epi32(v));
+			_mm256_storeu_si256(dst + 1, _mm256_cvtepu8_epi32(_mm_srli_si128(v, 8)));
+		}
+#elif defined(UTF8_TRANSCODE_SSE2)
+		const __m128i zero = _mm_setzero_si128();
+		for (; i + 16 <= n; i += 16) {
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+			if (_mm_movemask_epi8(v) != 0)
+				break;
+			__m128i lo = _mm_unpacklo_epi8(v, zero), hi = _mm_unpackhi_epi8(v, zero);
+			__m128i *dst = reinterpret_cast<__m128i *>(out + i);
+			_mm_storeu_si128(dst, _mm_unpacklo_epi16(lo, zero));
+			_mm_storeu_si128(dst + 1, _mm_unpackhi_epi16(lo, zero));
+			_mm_storeu_si128(dst + 2, _mm_unpacklo_epi16(hi, zero));
+			_mm_storeu_si128(dst + 3, _mm_unpackhi_epi16(hi, zero));
+		}
+#endif
+		return i;
+	}
+
+	// Narrows whole blocks of ASCII code points until one holds another, returns the number consumed
+	inline size_t narrow_ascii(const char32_t *s, size_t n, unsigned char *out)
+	{
+		size_t i = 0;
+#if defined(UTF8_TRANSCODE_SSE2)
+		const __m128i high = _mm_set1_epi32(~0x7F), zero = _mm_setzero_si128();
+		for (; i + 16 <= n; i += 16) {
+			const __m128i *src = reinterpret_cast<const __m128i *>(s + i);
+			__m128i a = _mm_loadu_si128(src), b = _mm_loadu_si128(src + 1);
+			__m128i c = _mm_loadu_si128(src + 2), d = _mm_loadu_si128(src + 3);
+			__m128i any = _mm_and_si128(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d)), high);
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, zero)) != 0xFFFF)
+				break;
+			// Every value is below 0x80, so the saturating packs are exact
+			__m128i packed = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), packed);
+		}
+#endif
+		return i;
+	}
+
+	// Offset of the first byte that is not part of well-formed UTF-8, or npos
+	inline size_t validate(std::string_view in)
+	{
+		const unsigned char *s = reinterpret_cast<const unsigned char *>(in.data());
+		const size_t n = in.size();
+		size_t i = 0;
+		while (i < n) {
+			i += ascii_prefix(s + i, n - i);
+			if (i == n)
+				break;
+			char32_t cp;
+			int len = sequence(s + i, n - i, cp);
+			if (len < 0)
+				return i;
+			i += len;
+		}
+		return std::string_view::npos;
+	}
+
+	// Appends the code points of in to out. On a strict failure out is left as it was.
+	inline void decode(std::string_view in, std::u32string &out, error_policy policy = error_policy::strict,
+	                   char32_t replacement = replacement_character)
+	{
+		const unsigned char *s = reinterpret_cast<const unsigned char *>(in.data());
+		const size_t n = in.size(), base = out.size();
+		// Never more code points than bytes
+		out.resize(base + n);
+		char32_t *dst = &out[0] + base;
+		size_t i = 0;
+		while (i < n) {
+			if (s[i] < 0x80) {
+				size_t run = widen_ascii(s + i, n - i, dst);
+				i += run;
+				dst += run;
+				while (i < n && s[i] < 0x80)
+					*dst++ = s[i++];
+				continue;
+			}
+			char32_t cp;
+			int len = sequence(s + i, n - i, cp);
+			if (len > 0) {
+				*dst++ = cp;
+				i += len;
+				continue;
+			}
+			if (policy == error_policy::strict) {
+				out.resize(base);
+				throw transcode_error("Codecvt: Bad UTF-8 encoding at offset " + std::to_string(i) + ".", i);
+			}
+			if (policy == error_policy::replace)
+				*dst++ = replacement;
+			i += -len;
+		}
+		out.resize(dst - out.data());
+	}
+
+	inline std::u32string decode(std::string_view in, error_policy policy = error_policy::strict,
+	                             char32_t replacement = replacement_character)
+	{
+		std::u32string out;
+		decode(in, out, policy, replacement);
+		return out;
+	}
+
+	inline bool encodable(char32_t cp)
+	{
+		return cp < 0xD800 || (cp > 0xDFFF && cp <= 0x10FFFF);
+	}
+
+	inline unsigned char *put(char32_t cp, unsigned char *dst)
+	{
+		if (cp < 0x80) {
+			*dst++ = cp;
+		}
+		else if (cp < 0x800) {
+			*dst++ = 0xC0 | cp >> 6;
+			*dst++ = 0x80 | (cp & 0x3F);
+		}
+		else if (cp < 0x10000) {
+			*dst++ = 0xE0 | cp >> 12;
+			*dst++ = 0x80 | (cp >> 6 & 0x3F);
+			*dst++ = 0x80 | (cp & 0x3F);
+		}
+		else {
+			*dst++ = 0xF0 | cp >> 18;
+			*dst++ = 0x80 | (cp >> 12 & 0x3F);
+			*dst++ = 0x80 | (cp >> 6 & 0x3F);
+			*dst++ = 0x80 | (cp & 0x3F);
+		}
+		return dst;
+	}
+
+	// Appends the UTF-8 form of in to out. Surrogates and values above U+10FFFF are invalid;
+	// on a strict failure out is left as it was.
+	inline void encode(std::u32string_view in, std::string &out, error_policy policy = error_policy::strict,
+	                   char32_t replacement = replacement_character)
+	{
+		const size_t n = in.size(), base = out.size();
+		if (!encodable(replacement))
+			replacement = replacement_character;
+		const size_t replacement_size = replacement < 0x80 ? 1 : replacement < 0x800 ? 2 : replacement < 0x10000 ? 3 : 4;
+		// Sized exactly first, so ASCII-heavy text does not reserve four bytes per code point
+		size_t size = 0;
+		for (size_t i = 0; i < n; ++i) {
+			char32_t cp = in[i];
+			if (cp < 0x80)
+				size += 1;
+			else if (cp < 0x800)
+				size += 2;
+			else if (!encodable(cp)) {
+				if (policy == error_policy::strict)
+					throw transcode_error("Codecvt: Code point at index " + std::to_string(i) + " cannot be encoded in UTF-8.", i);
+				if (policy == error_policy::replace)
+					size += replacement_size;
+			}
+			else
+				size += cp < 0x10000 ? 3 : 4;
+		}
+		out.resize(base + size);
+		unsigned char *dst = reinterpret_cast<unsigned char *>(&out[0]) + base;
+		const char32_t *s = in.data();
+		size_t i = 0;
+		while (i < n) {
+			if (s[i] < 0x80) {
+				size_t run = narrow_ascii(s + i, n - i, dst);
+				i += run;
+				dst += run;
+				while (i < n && s[i] < 0x80)
+					*dst++ = s[i++];
+				continue;
+			}
+			char32_t cp = s[i++];
+			if (encodable(cp))
+				dst = put(cp, dst);
+			else if (policy == error_policy::replace)
+				dst = put(replacement, dst);
+		}
+	}
+
+	inline std::string encode(std::u32string_view in, error_policy policy = error_policy::strict,
+	                          char32_t replacement = replacement_character)
+	{
+		std::string out;
+		encode(in, out, policy, replacement);
+		return out;
+	}
+} // namespace utf8_transcode